@@ -1,22 +1,67 @@
 ﻿#include "advancedtoolbox.h"
 
+#include <QAbstractItemModel>
 #include <QApplication>
+#include <QContextMenuEvent>
+#include <QDataStream>
 #include <QDebug>
 #include <QDrag>
+#include <QElapsedTimer>
 #include <QEvent>
+#include <QFutureWatcher>
+#include <QHash>
 #include <QLayoutItem>
+#include <QLineEdit>
+#include <QListView>
 #include <QMenu>
 #include <QMimeData>
 #include <QMouseEvent>
 #include <QPainter>
-#include <QParallelAnimationGroup>
+#include <QPixmap>
+#include <QPixmapCache>
+#include <QPointer>
 #include <QPropertyAnimation>
 #include <QAbstractButton>
 #include <QRubberBand>
+#include <QSet>
+#include <QScrollBar>
+#include <QSortFilterProxyModel>
 #include <QStyleOption>
+#include <QTimer>
+#include <QVariantAnimation>
+#include <QVBoxLayout>
+#include <QWheelEvent>
+#include <QWidgetAction>
+#include <QtConcurrentRun>
 #include <QtMath>
+#include <algorithm>
+#include <climits>
 #include <functional>
 
+// 动画期间盖在页面上的截图，避免每一帧都重新布局用户的widget
+class ToolBoxPageSnapshot : public QWidget
+{
+  public:
+    ToolBoxPageSnapshot(const QPixmap &pixmap, QWidget *parent)
+        : QWidget(parent)
+        , pixmap(pixmap)
+    {
+        setAttribute(Qt::WA_OpaquePaintEvent);
+        setAttribute(Qt::WA_TransparentForMouseEvents);
+    }
+
+  protected:
+    void paintEvent(QPaintEvent *) override
+    {
+        QPainter p(this);
+        p.fillRect(rect(), palette().window());
+        p.drawPixmap(0, 0, pixmap);
+    }
+
+  private:
+    QPixmap pixmap;
+};
+
 class ToolBoxPageContainer : public QWidget
 {
   public:
@@ -24,11 +69,273 @@ class ToolBoxPageContainer : public QWidget
     bool event(QEvent *e)
     {
         if(e->type() == QEvent::LayoutRequest)
+        {
+            // 标记页面尺寸需要重新计算，由AdvancedToolBox处理LayoutRequest时统一计算
+            sizeDirty = true;
             updateGeometry();
+        }
         return QWidget::event(e);
     }
+
+    // 用widget当前的样子盖住容器，size为截图需要覆盖的区域
+    void setSnapshot(QWidget *widget, const QSize &size)
+    {
+        clearSnapshot();
+        snapshot = new ToolBoxPageSnapshot(widget->grab(), this);
+        snapshot->setGeometry(QRect(QPoint(0, 0), size));
+        snapshot->show();
+        snapshot->raise();
+    }
+    void clearSnapshot()
+    {
+        delete snapshot;
+        snapshot = nullptr;
+    }
+
+    bool sizeDirty = false;
+    ToolBoxPageSnapshot *snapshot = nullptr;
+};
+
+static const QSize titleIconSize(16, 16);
+
+// 所有AdvancedToolBox共用的标题文字和图标池，只在GUI线程使用。
+// 图标按cacheKey共用，同一个QIcon的副本共享预先渲染的pixmap；池增长时清理不再被页面引用的条目
+class ToolBoxSharedPool
+{
+  public:
+    static ToolBoxSharedPool &instance()
+    {
+        static ToolBoxSharedPool pool;
+        // QApplication析构时清空，避免静态对象在QApplication之后析构pixmap
+        if(!pool.registered)
+        {
+            pool.registered = true;
+            qAddPostRoutine(&ToolBoxSharedPool::cleanup);
+        }
+        return pool;
+    }
+
+    static void cleanup()
+    {
+        ToolBoxSharedPool &pool = instance();
+        pool.texts.clear();
+        pool.icons.clear();
+        pool.registered = false;
+    }
+
+    QString text(const QString &text)
+    {
+        if(text.isEmpty())
+            return text;
+        auto it = texts.constFind(text);
+        if(it != texts.constEnd())
+            return *it;
+        if(texts.size() >= textPurgeSize)
+        {
+            for(auto i = texts.begin(); i != texts.end();)
+            {
+                if(i->isDetached())
+                    i = texts.erase(i);
+                else
+                    ++i;
+            }
+            textPurgeSize = qMax(256, texts.size() * 2);
+        }
+        texts.insert(text);
+        return text;
+    }
+
+    QIcon icon(const QIcon &icon)
+    {
+        // 只按cacheKey判断，不同来源的图标在其他模式、状态或缩放下可能不同，不做合并
+        if(icon.isNull() || icons.contains(icon.cacheKey()))
+            return icon;
+
+        if(icons.size() >= iconPurgeSize)
+        {
+            for(auto i = icons.begin(); i != icons.end();)
+            {
+                if(i->icon.isDetached())
+                    i = icons.erase(i);
+                else
+                    ++i;
+            }
+            iconPurgeSize = qMax(64, icons.size() * 2);
+        }
+        icons[icon.cacheKey()].icon = icon;
+        return icon;
+    }
+
+    // 共用图标预先渲染的pixmap，不在池中的图标返回空pixmap
+    QPixmap pixmap(const QIcon &icon, const QSize &size, QIcon::Mode mode, QIcon::State state, qreal dpr)
+    {
+        auto it = icons.find(icon.cacheKey());
+        if(it == icons.end())
+            return QPixmap();
+        Entry &entry = it.value();
+        if(entry.size != size || entry.dpr != dpr)
+        {
+            for(QPixmap &pixmap : entry.pixmaps)
+                pixmap = QPixmap();
+            entry.size = size;
+            entry.dpr = dpr;
+        }
+        QPixmap &pixmap = entry.pixmaps[int(mode) * 2 + int(state)];
+        if(pixmap.isNull())
+        {
+            pixmap = icon.pixmap(size * dpr, mode, state);
+            pixmap.setDevicePixelRatio(dpr);
+        }
+        return pixmap;
+    }
+
+    // 图标在池中预先渲染的字节数，不在池中或尚未渲染时按一个标题尺寸的pixmap估计
+    qint64 iconBytes(const QIcon &icon) const
+    {
+        qint64 bytes = 0;
+        auto it = icons.constFind(icon.cacheKey());
+        if(it != icons.constEnd())
+        {
+            for(const QPixmap &pixmap : it->pixmaps)
+                bytes += qint64(pixmap.width()) * pixmap.height() * pixmap.depth() / 8;
+        }
+        return bytes > 0 ? bytes : qint64(titleIconSize.width()) * titleIconSize.height() * 4;
+    }
+
+  private:
+    struct Entry
+    {
+        QIcon icon;
+        QSize size;
+        qreal dpr = 0;
+        QPixmap pixmaps[8]; // QIcon::Mode * QIcon::State
+    };
+
+    QSet<QString> texts;
+    QHash<qint64, Entry> icons; // 共用图标的cacheKey
+    int textPurgeSize = 256;
+    int iconPurgeSize = 64;
+    bool registered = false;
 };
 
+// 标题的建议尺寸，ToolBoxTitle和绘制标题模式共用
+static QSize toolBoxTitleSize(const QStyleOptionTab &opt, const QSize &iconSize, QStyle *style, const QWidget *widget)
+{
+    int w = style->pixelMetric(QStyle::PM_TabBarTabHSpace, &opt, widget);
+    int h = style->pixelMetric(QStyle::PM_TabBarTabVSpace, &opt, widget);
+
+    w += iconSize.width();
+    w += iconSize.isEmpty() ? 0 : 4;
+
+    const QFontMetrics &fm = opt.fontMetrics;
+    w += fm.size(0, opt.text).width();
+    h += qMax(fm.height(), iconSize.height());
+    return style->sizeFromContents(QStyle::CT_TabBarTab, &opt, QSize(w, h), widget);
+}
+
+// 在tabopt.rect内绘制标题：背景、展开折叠图标、页面图标以及文字
+static void drawToolBoxTitle(QStyleOptionToolBox tabopt, bool hoverBranch, int indent, const QSize &iconSize,
+                             QStyle *style, QPainter *painter, const QWidget *widget)
+{
+    style->drawControl(QStyle::CE_ToolBoxTabShape, &tabopt, painter, widget);
+
+    // draw branch
+    if(indent > 0)
+    {
+        QStyleOptionViewItem branchopt;
+        branchopt.rect = tabopt.rect;
+        branchopt.state = tabopt.state;
+        branchopt.state &= ~QStyle::State_MouseOver;
+        branchopt.state |= hoverBranch ? QStyle::State_MouseOver : QStyle::State_None;
+        branchopt.state |= QStyle::State_Children;
+        branchopt.rect.setRight(tabopt.rect.left() + indent);
+        style->drawPrimitive(QStyle::PE_IndicatorBranch, &branchopt, painter, widget);
+    }
+    tabopt.rect.setLeft(tabopt.rect.left() + indent);
+
+    // draw icon
+    bool null_icon = tabopt.icon.isNull();
+    int icon_width = iconSize.width();
+    if(!null_icon)
+    {
+        QRect cr = style->subElementRect(QStyle::SE_ToolBoxTabContents, &tabopt, widget);
+        cr.setWidth(icon_width + 2);
+        cr.moveLeft(cr.left() + 2);
+        QIcon::Mode mode = tabopt.state & QStyle::State_Enabled ? QIcon::Normal : QIcon::Disabled;
+        if(mode == QIcon::Normal && tabopt.state & QStyle::State_HasFocus)
+            mode = QIcon::Active;
+        QIcon::State state = tabopt.state & QStyle::State_Open ? QIcon::On : QIcon::Off;
+        const QPixmap pixmap = ToolBoxSharedPool::instance().pixmap(tabopt.icon, iconSize, mode, state,
+                                                                    painter->device()->devicePixelRatioF());
+        if(pixmap.isNull())
+            tabopt.icon.paint(painter, cr, Qt::AlignCenter, mode, state);
+        else
+            painter->drawPixmap(QStyle::alignedRect(Qt::LeftToRight, Qt::AlignCenter, iconSize, cr), pixmap);
+        tabopt.rect.adjust(icon_width + 4, 0, 0, 0);
+    }
+
+    // draw text
+    if(!tabopt.text.isEmpty())
+    {
+        tabopt.icon = QIcon();
+        // QStyleOptionToolBox固定左对齐。可以考虑使用 QStyleOptionTab 绘制文本，以支持样式对齐，不过默认是居中样式。
+        style->drawControl(QStyle::CE_ToolBoxTabLabel, &tabopt, painter, widget);
+    }
+}
+
+// 标题缓存使用的样式序号，在进程内唯一。QPixmapCache是全局的，不同AdvancedToolBox的style sheet可能不同
+static quint64 nextTitleStyleSerial()
+{
+    static quint64 serial = 0;
+    return ++serial;
+}
+
+// 使用QPixmapCache缓存标题绘制结果，key包含文字、图标、状态、尺寸、设备像素比、调色板和样式，
+// styleSerial在样式、字体或调色板变化时更新，使旧的缓存失效，因此字体不再放入key
+static void drawCachedToolBoxTitle(const QStyleOptionToolBox &tabopt, bool hoverBranch, int indent, const QSize &iconSize,
+                                   quint64 styleSerial, QStyle *style, QPainter *painter, const QWidget *widget)
+{
+    const QSize size = tabopt.rect.size();
+    if(size.isEmpty())
+        return;
+
+    const qreal dpr = painter->device()->devicePixelRatioF();
+    const QStyle::State state = tabopt.state & (QStyle::State_Enabled | QStyle::State_MouseOver | QStyle::State_Sunken |
+                                                QStyle::State_Open | QStyle::State_HasFocus | QStyle::State_Active);
+    // key使用固定长度的二进制头加上文字，每次绘制只分配一次，不再逐个格式化数字
+    quint64 fields[8];
+    fields[0] = quintptr(style);
+    fields[1] = styleSerial;
+    fields[2] = tabopt.icon.cacheKey();
+    fields[3] = quint64(quint32(state)) | (hoverBranch ? Q_UINT64_C(0x100000000) : 0);
+    fields[4] = (quint64(quint32(size.width())) << 32) | quint32(size.height());
+    fields[5] = quint64(qRound64(dpr * 1000));
+    fields[6] = quint32(indent);
+    fields[7] = tabopt.palette.cacheKey();
+
+    static const QLatin1String prefix("AdvancedToolBoxTitle:");
+    QString key;
+    key.reserve(prefix.size() + int(sizeof(fields) / sizeof(QChar)) + tabopt.text.size());
+    key.append(prefix);
+    key.append(reinterpret_cast<const QChar *>(fields), int(sizeof(fields) / sizeof(QChar)));
+    key.append(tabopt.text);
+
+    QPixmap pixmap;
+    if(!QPixmapCache::find(key, &pixmap))
+    {
+        pixmap = QPixmap(size * dpr);
+        pixmap.setDevicePixelRatio(dpr);
+        pixmap.fill(Qt::transparent);
+        QStyleOptionToolBox opt = tabopt;
+        opt.rect = QRect(QPoint(0, 0), size);
+        QPainter p(&pixmap);
+        drawToolBoxTitle(opt, hoverBranch, indent, iconSize, style, &p, widget);
+        p.end();
+        QPixmapCache::insert(key, pixmap);
+    }
+    painter->drawPixmap(tabopt.rect.topLeft(), pixmap);
+}
+
 class ToolBoxTitle : public QAbstractButton
 {
     Q_OBJECT
@@ -47,6 +354,12 @@ class ToolBoxTitle : public QAbstractButton
     {
         return sizeHint();
     }
+    // 宽度缓存只随文字自动更新，字体或样式变化后由AdvancedToolBox统一清除
+    void resetSizeHint()
+    {
+        _sizeHint = QSize();
+        updateGeometry();
+    }
     void setExpanded(bool expanded)
     {
         if(this->expanded != expanded)
@@ -60,22 +373,19 @@ class ToolBoxTitle : public QAbstractButton
     bool event(QEvent *e);
     void initStyleOption(QStyleOptionToolBox *option) const;
     void paintEvent(QPaintEvent *);
-    void changeEvent(QEvent *e)
-    {
-        _sizeHint = QSize();
-        updateGeometry();
-        QWidget::changeEvent(e);
-    }
 
   private:
     QPoint pressedPos;
     bool pressed = false;
     bool expanded = true;
     mutable QSize _sizeHint;
+    mutable QString _sizeHintText;
     bool hoverBranch = false;
     int tabIndex = -1;
 };
 
+class ToolBoxPageListModel;
+
 class AdvancedToolBoxPrivate : public QObject
 {
 
@@ -99,32 +409,157 @@ class AdvancedToolBoxPrivate : public QObject
     }
 
     QWidget *takeIndex(int index);
+    QWidget *removeItem(int index);
     QWidget *widget(int index);
+    inline int indexOf(QObject *widget) const
+    {
+        ToolBoxItem *item = widgetItems.value(widget);
+        return item ? itemIndex(item) : -1;
+    }
+    inline int itemIndex(ToolBoxItem *item) const;
 
     void setIndexExpand(int index, bool expand = true);
     void setIndexVisible(int index, bool visible = true);
+    bool updatePageShown(ToolBoxItem *item);
+    void notifyPageState(int index, bool expandChanged, bool shownChanged);
+    void setSuspendCollapsed(bool enable);
+    void suspendPage(ToolBoxItem *item);
+    void resumePage(ToolBoxItem *item);
+    void suspendQueuedPages();
 
     void styleChangedEvent();
 
     void setIndentation(int i);
 
+    ToolBoxItem *createItem(int index, const QString &label, const QIcon &icon);
     void insertWidgetToList(int index, QWidget *widget, const QString &label, const QIcon &icon = QIcon());
-    void doLayout();
+    void insertLazyToList(int index, const AdvancedToolBox::WidgetFactory &factory, const QSize &estimate,
+                          const QString &label, const QIcon &icon = QIcon());
+    void doLayout(bool force = false);
+    void reserveLayout(int count);
+    void requestLayout();
+    void layoutRequestEvent();
 
     void expandStateChanged(int index, bool expand);
     void moveHandle(int index, int distance);
-    void updateGeometries(bool animate = false);
+    int handleLimit(int index, int distance) const;
+    void handlePressed(int index);
+    void handleMoved(int index, int distance);
+    void handleReleased();
+    void updateGeometries(bool animate = false, bool moveOnly = false);
+    int spanAt(int y) const;
+    int pageAt(int y) const;
+    void applyGeometry(ToolBoxItem *item, const QRect &rect, int titleHeight, bool freezeSize);
+    void animationFrame(const QVariant &value);
+    void animationFinished();
 
     void resetPages();
     ToolBoxSplitterHandle *createHandle();
+    int titleHeight(bool hasIcon);
+    inline int titleHeight(ToolBoxItem *item);
+    inline void resetTitleMetrics()
+    {
+        titleHeights[0] = titleHeights[1] = -1;
+    }
+    void titleMetricsChanged();
+    void updateTitle(ToolBoxItem *item);
+    QPixmap grabTitle(ToolBoxItem *item);
+
+    // 绘制标题模式
+    enum HitPart
+    {
+        HitNone,
+        HitTitle,
+        HitHandle
+    };
+    void setPaintedTitles(bool enable);
+    void paintTitle(QPainter *painter, ToolBoxItem *item);
+    ToolBoxItem *hitTest(const QPoint &pos, HitPart *part) const;
+    void setHover(const QPoint &pos);
+    bool titleMousePress(QMouseEvent *event);
+    bool titleMouseMove(QMouseEvent *event);
+    bool titleMouseRelease(QMouseEvent *event);
+    bool titleContextMenu(QContextMenuEvent *event);
     ToolBoxTitle *createTitle(const QString &label, const QIcon &icon);
     void showTitleMenu(int index, const QPoint &pos);
+    void ensureTitleMenu();
+    void ensurePageList();
+    void syncTitleMenu();
+    void titleMenuChanged(bool rebuild);
 
     void setDragRubberVisible(bool visible, const QRect &rect = QRect());
     void updateTitleIndent();
     void resetManualSize();
     void widgetDestroyed(QObject *o);
     void resetSizeHint();
+    void calItemSize(ToolBoxItem *item);
+    void setItemSizeProvider(ToolBoxItem *item, const AdvancedToolBox::SizeProvider &provider);
+    void setSharedResources(bool enable);
+    inline QString shareText(const QString &text) const
+    {
+        return sharedResources ? ToolBoxSharedPool::instance().text(text) : text;
+    }
+    inline QIcon shareIcon(const QIcon &icon) const
+    {
+        return sharedResources ? ToolBoxSharedPool::instance().icon(icon) : icon;
+    }
+    void populate(const AdvancedToolBox::PageGenerator &generator, int total, int frameBudget);
+    void populateChunk();
+    void finishPopulate(bool canceled);
+    void itemSizeProvided(ToolBoxItem *item, const QSize &size);
+
+    void statsChanged();
+
+    void beginUpdate();
+    void endUpdate();
+
+    QByteArray saveState() const;
+    bool restoreState(const QByteArray &state);
+
+    void clearPages(bool deleteWidgets);
+    void setModel(QAbstractItemModel *m, const AdvancedToolBox::PageFactory &factory, const QModelIndex &root);
+    void insertModelRows(int first, int last);
+    void modelRowsInserted(const QModelIndex &parent, int first, int last);
+    void modelRowsRemoved(const QModelIndex &parent, int first, int last);
+    void modelRowsMoved(const QModelIndex &parent, int start, int end, const QModelIndex &destination, int row);
+    void modelDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles);
+    void modelLayoutChanged(const QList<QPersistentModelIndex> &parents);
+    void modelReset();
+
+    void setVirtualEnable(bool enable);
+    void setScrollEnable(bool enable);
+    QRect contentRect() const;
+    void placeScrollBar();
+    void updateScrollRange();
+    void scrollTo(int value);
+    void updateStickyTitle();
+    void watchViewport();
+    QRect viewportRect() const;
+    void updateVirtualPages(int top = INT_MIN, int bottom = INT_MAX);
+    ToolBoxPageContainer *ensureContainer(ToolBoxItem *item);
+    QWidget *ensureParkingLot();
+    void releaseContainer(ToolBoxItem *item);
+    bool eventFilter(QObject *watched, QEvent *event) override;
+
+    bool materializePage(ToolBoxItem *item);
+    void scheduleLazyPages();
+    void materializeLazyPages();
+    void pageCollapsed(ToolBoxItem *item);
+    void releaseLazyPages();
+
+    // 标记需要重新设置位置的页面范围
+    inline void markDirty(int first, int last)
+    {
+        dirtyFirst = qMin(dirtyFirst, first);
+        dirtyLast = qMax(dirtyLast, last);
+    }
+
+    // 标记从from开始的页面顺序或显示状态发生了变化，menu为false时菜单中的页面列表不用重建
+    inline void markPagesDirty(int from, bool menu = true)
+    {
+        pagesDirtyFrom = qMin(pagesDirtyFrom, qMax(from, 0));
+        titleMenuChanged(menu);
+    }
 
   protected:
     int indent = 10;
@@ -133,42 +568,246 @@ class AdvancedToolBoxPrivate : public QObject
     QSize sizeHint;
     int boxSpacing = 0;
     QList<ToolBoxItem *> items;
+    QHash<QObject *, ToolBoxItem *> widgetItems; // 页面widget到页面的映射
+    quint64 nextItemId = 1;
+
+    // 增量布局：只有[dirtyFirst, dirtyLast]内的页面高度发生过变化，
+    // 之后的页面如果位置未变，则不再处理
+    int dirtyFirst = INT_MAX;
+    int dirtyLast = -1;
+    int contentBottom = -1;
+    int layoutWidth = -1;
+    int pagesDirtyFrom = 0;    // 序号和handle显示需要从该位置开始更新
+    // 拖动handle过程中修改过的页面范围
+    int dragFirst = INT_MAX;
+    int dragLast = -1;
+    // 正在拖动的handle以及按下后的移动距离
+    AdvancedToolBox::ResizeMode resizeMode = AdvancedToolBox::OpaqueResize;
+    int handleIndex = -1;
+    int handleDistance = 0;
+    QRubberBand *resizeRubber = nullptr;
+    QTimer *resizeTimer = nullptr;
+    // 可见页面按顺序排列的序号和区域底部位置（包含上方handle和标题），由updateGeometries维护，
+    // 用于二分查找某个位置所在的页面
+    QVector<int> spanIndex;
+    QVector<int> spanBottoms;
+
+    // 批量修改时延迟执行的操作
+    int updateDepth = 0;
+    bool pendingSizeHint = false;
+    bool pendingLayout = false;
+    bool pendingGeometries = false;
+
+    // 延迟布局模式
+    bool deferredLayout = false;
+    bool layoutRequested = false;
+
+    // 虚拟化：只有与可见区域相交的页面才持有容器，其余页面的widget放到隐藏的parkingLot中
+    bool virtualEnable = false;
+    QWidget *parkingLot = nullptr;
+    QList<ToolBoxPageContainer *> containerPool;
+    QVector<ToolBoxItem *> boundItems; // 当前持有容器的页面
+    QPointer<QWidget> viewport;
+    // 用户设置的虚拟化和绘制标题，滚动模式下两者总是打开
+    bool virtualSetting = false;
+    bool paintedSetting = false;
+
+    // 滚动模式：页面位置保存为窗口坐标，滚动时整体平移，只有可见的页面持有子窗口
+    bool scrollEnable = false;
+    int scrollValue = 0;
+    QScrollBar *scrollBar = nullptr;
+    ToolBoxTitle *stickyTitle = nullptr; // 固定在顶部的当前页面标题
+    ToolBoxItem *stickyItem = nullptr;
+
+    // model模式：页面与modelRoot下的行一一对应
+    QPointer<QAbstractItemModel> model;
+    QPersistentModelIndex modelRoot;
+    AdvancedToolBox::PageFactory pageFactory;
+    bool modelPages = false; // 当前页面由model创建，移除时销毁widget
+
+    // 运行统计
+    bool statsEnable = false;
+    bool statsPending = false;
+    AdvancedToolBox::Stats stats;
+
+    // 标题文字和图标放入共用的池中
+    bool sharedResources = false;
+
+    // 挂起折叠的页面，折叠动画结束后才隐藏widget
+    bool suspendCollapsed = false;
+    QVector<ToolBoxItem *> suspendQueue;
+
+    // 分批填充页面
+    AdvancedToolBox::PageGenerator populateGenerator;
+    QTimer *populateTimer = nullptr;
+    int populateBudget = 8;
+    int populateCount = 0;
+    int populateTotal = -1;
+    quint32 populateSerial = 0; // 每次开始或结束填充时递增，用于发现生成器或信号中的取消和重新开始
+
+    // 延迟创建的页面
+    int lazyCount = 0;
+    int lazyReleaseTimeout = -1;
+    QTimer *lazyTimer = nullptr;
+    QTimer *releaseTimer = nullptr;
+
+    // doLayout中分配空间使用的连续数组（页面、高度、最小、最大、排序），只增长不收缩，
+    // 稳定后布局和拖动handle都不再分配内存
+    QVector<ToolBoxItem *> layoutItems;
+    QVector<int> layoutSizes;
+    QVector<int> layoutMins;
+    QVector<int> layoutMaxs;
+    QVector<int> layoutOrder;
 
     QRubberBand *dragRubber = nullptr;
 
+    // 标题右键菜单
+    QMenu *titleMenu = nullptr;
+    QAction *hideAction = nullptr;
+    QAction *menuSeparator = nullptr; // 应用添加的action之前的分隔线
+    QList<QAction *> pageActions;
+    QWidgetAction *pageListAction = nullptr;
+    ToolBoxPageListModel *pageModel = nullptr;
+    ToolBoxItem *menuItem = nullptr;
+    int menuVisibleCount = 0;
+    bool menuDirty = true;
+    bool menuSyncPending = false;
+
+    // 展开和折叠动画：所有页面共用一个时间轴，每一帧统一插值并设置位置
+    struct AnimatedPage
+    {
+        ToolBoxItem *item;
+        QRect start;
+        QRect end;
+        int titleHeight;
+        bool freezeSize;
+        bool snapshot;
+    };
+    QVariantAnimation *timeline = nullptr;
+    QVector<AnimatedPage> animatedPages;
+
     bool isAnimationState = false;
     bool nextIsAnimation = false;
     bool dragSortEnable = true;
     bool animationEnable = true;
+    bool snapshotAnimation = false;
+
+    // 绘制标题模式：标题和handle不再是子窗口，由AdvancedToolBox绘制并处理鼠标事件
+    bool paintedTitles = false;
+    // 标题绘制缓存
+    bool titleCacheEnable = false;
+    quint64 titleStyleSerial = nextTitleStyleSerial();
+    // 有图标和无图标时的标题高度，小于0表示需要重新计算
+    int titleHeights[2] = {-1, -1};
+    ToolBoxItem *hoverItem = nullptr;
+    bool hoverBranch = false;
+    bool handleCursor = false;
+    ToolBoxItem *pressItem = nullptr;
+    HitPart pressPart = HitNone;
+    bool titleDown = false;
+    QPoint pressPos;
 
     AdvancedToolBox *q_ptr = nullptr;
     friend class AdvancedToolBox;
     friend class ToolBoxSplitterHandle;
+    friend class ToolBoxTitle;
+    friend class ToolBoxStatsScope;
+    friend class ToolBoxPageListModel;
 };
 
 class AdvancedToolBoxPrivate::ToolBoxItem
 {
     QWidget *widget = nullptr;
-    ToolBoxSplitterHandle *handle = nullptr; // 移动handle
-    ToolBoxTitle *tabTitle = nullptr;        // 标题栏文字、图标等
-    QWidget *tabContainer = nullptr;         // 容器，方便做折叠动画
-
+    ToolBoxSplitterHandle *handle = nullptr; // 移动handle，绘制标题模式下为空
+    ToolBoxTitle *tabTitle = nullptr;        // 标题栏文字、图标等，绘制标题模式下为空
+    ToolBoxPageContainer *tabContainer = nullptr; // 容器，方便做折叠动画
+
+    quint64 id = 0;                   // 页面唯一标识，不随顺序变化
+    QString text;                     // 标题文字
+    QIcon icon;                       // 标题图标
+    int index = -1;
+    QRect geometry;                   // 最近一次设置的容器位置
+    int titleHeight = -1;             // 最近一次布局使用的标题高度
     int layoutHeight = 0;             // 实际布局高度
     QSize sizeHint;                 // 建议高度
     QSize minSize;                  // 最小高度
     QSize maxSize;                  // 最大高度
     int manualHeight = 0;             // 手动高度，用于在调整高度或者展开折叠后做一次缓存，避免resize时抖动
 
-    bool freezeTarget = false;
-    bool isExpanded = true;
+    // 状态使用位域，减少每个页面记录的大小
+    bool freezeTarget : 1;
+    bool isExpanded : 1;
+    bool hidden : 1;
+    bool shown : 1;                   // 最近一次通知的内容显示状态（展开且未隐藏）
+    bool suspended : 1;               // 按挂起策略隐藏了widget并关闭了刷新
     inline bool expanded() { return isExpanded; }
 
+    // 延迟创建、model和后台尺寸计算才用到的数据单独分配，普通页面只占一个指针
+    struct Extra
+    {
+        AdvancedToolBox::WidgetFactory factory; // 延迟创建页面的factory
+        QPersistentModelIndex modelIndex;        // model模式下对应的行，排序或过滤后据此恢复顺序
+        QSize estimate;                          // widget创建之前使用的建议尺寸
+        QElapsedTimer collapsedTime;             // 折叠或隐藏的时间，用于超时销毁widget
+        QSize providedSize;                      // 后台计算的建议尺寸，有效时代替widget的sizeHint
+        QFutureWatcher<QSize> *sizeWatcher = nullptr; // 正在进行的后台尺寸计算
+    };
+    Extra *extra = nullptr;
+
+    ToolBoxItem()
+        : freezeTarget(false)
+        , isExpanded(true)
+        , hidden(false)
+        , shown(true)
+        , suspended(false)
+    {
+    }
+
+    ~ToolBoxItem()
+    {
+        if(extra)
+            delete extra->sizeWatcher;
+        delete extra;
+    }
+
+    Extra *ensureExtra()
+    {
+        if(!extra)
+            extra = new Extra;
+        return extra;
+    }
+
+    inline bool isLazy() const
+    {
+        return extra && extra->factory;
+    }
+
+    inline void resetCollapsedTime()
+    {
+        if(extra)
+            extra->collapsedTime.invalidate();
+    }
+
     void calItemSize()
     {
-        QWidgetItem wi(widget);
-        sizeHint = wi.sizeHint();
-        minSize = wi.minimumSize();
-        maxSize = wi.maximumSize();
+        const QSize provided = extra ? extra->providedSize : QSize();
+        if(!widget)
+        {
+            // widget尚未创建，最小和最大尺寸保持不变
+            sizeHint = provided.isValid() ? provided : (extra ? extra->estimate : QSize());
+            if(!minSize.isValid())
+                minSize = QSize(0, 0);
+            if(!maxSize.isValid())
+                maxSize = QSize(QWIDGETSIZE_MAX, QWIDGETSIZE_MAX);
+        }
+        else
+        {
+            QWidgetItem wi(widget);
+            // 后台计算过尺寸时不再向widget查询sizeHint
+            sizeHint = provided.isValid() ? provided : wi.sizeHint();
+            minSize = wi.minimumSize();
+            maxSize = wi.maximumSize();
+        }
         if(sizeHint.height() < 0)
             sizeHint.rheight() = 100;
     }
@@ -185,29 +824,186 @@ class AdvancedToolBoxPrivate::ToolBoxItem
 
     inline bool canResize() const
     {
-        return !widget->isHidden() && isExpanded;
+        return !hidden && isExpanded;
     }
 
     inline bool isHidden() const
     {
-        return widget->isHidden();
+        return hidden;
+    }
+
+    // widget本身是否应该显示
+    inline bool widgetVisible() const
+    {
+        return !hidden && !suspended;
     }
 
     inline QString title() const
     {
-        return tabTitle->text();
+        return text;
+    }
+
+    inline QRect titleRect() const
+    {
+        return QRect(geometry.left(), geometry.top() - titleHeight, geometry.width(), titleHeight);
+    }
+
+    // 标题上方handle的位置，handle太窄时上下各扩展2个像素方便拖动
+    inline QRect handleRect(int handleWidth) const
+    {
+        QRect rect(geometry.left(), geometry.top() - titleHeight - handleWidth, geometry.width(), handleWidth);
+        if(handleWidth <= 1)
+            rect.adjust(0, -2, 0, 2);
+        return rect;
     }
 
     friend class AdvancedToolBox;
     friend class AdvancedToolBoxPrivate;
+    friend class ToolBoxPageListModel;
 };
 
 using AdToolBoxItem = AdvancedToolBoxPrivate::ToolBoxItem;
 
+// 序号在resetPages中增量维护，尚未更新时回退到查找
+inline int AdvancedToolBoxPrivate::itemIndex(ToolBoxItem *item) const
+{
+    int index = item->index;
+    if(index >= 0 && index < items.count() && items.at(index) == item)
+        return index;
+    return items.indexOf(item);
+}
+
+inline int AdvancedToolBoxPrivate::titleHeight(ToolBoxItem *item)
+{
+    return titleHeight(!item->icon.isNull());
+}
+
+#ifndef ADVANCEDTOOLBOX_NO_STATS
+// 统计一次调用的次数和耗时，未开启统计时不计时
+class ToolBoxStatsScope
+{
+  public:
+    ToolBoxStatsScope(AdvancedToolBoxPrivate *d, quint64 AdvancedToolBox::Stats::*count, qint64 AdvancedToolBox::Stats::*nsecs)
+        : d(d)
+        , count(count)
+        , nsecs(nsecs)
+    {
+        if(d->statsEnable)
+            timer.start();
+    }
+    ~ToolBoxStatsScope()
+    {
+        if(!timer.isValid())
+            return;
+        d->stats.*nsecs += timer.nsecsElapsed();
+        d->stats.*count += 1;
+        d->statsChanged();
+    }
+
+  private:
+    Q_DISABLE_COPY(ToolBoxStatsScope)
+    AdvancedToolBoxPrivate *d;
+    quint64 AdvancedToolBox::Stats::*count;
+    qint64 AdvancedToolBox::Stats::*nsecs;
+    QElapsedTimer timer;
+};
+
+#define TOOLBOX_STATS_SCOPE(d, name) \
+    ToolBoxStatsScope toolBoxStatsScope((d), &AdvancedToolBox::Stats::name##Count, &AdvancedToolBox::Stats::name##Nsecs)
+#define TOOLBOX_STATS_ADD(d, field) \
+    do { if((d)->statsEnable) { (d)->stats.field += 1; (d)->statsChanged(); } } while(0)
+#else
+#define TOOLBOX_STATS_SCOPE(d, name)
+#define TOOLBOX_STATS_ADD(d, field) do {} while(0)
+#endif
+
+// 在order[0, n)上按权重分配remain（weighted为false时平均分配），返回全部达到最大/最小值后剩余的空间
+static qint64 spreadSpace(int *sizes, const int *minimums, const int *maximums, int *order, int n,
+                          qint64 remain, bool grow, bool weighted)
+{
+    // 每一项还能伸缩的空间
+    auto roomOf = [=](int i) -> qint64 {
+        const qint64 room = grow ? qint64(maximums[i]) - sizes[i] : qint64(sizes[i]) - minimums[i];
+        return qMax<qint64>(room, 0);
+    };
+    auto weightOf = [=](int i) -> qint64 {
+        return weighted ? qMax(sizes[i], 0) : 1;
+    };
+
+    qint64 totalWeight = 0;
+    for(int k = 0; k < n; k++)
+        totalWeight += weightOf(order[k]);
+
+    // 按照 room/weight 从小到大排序，比值越小越先达到最大/最小值
+    std::sort(order, order + n, [&](int a, int b) {
+        return roomOf(a) * weightOf(b) < roomOf(b) * weightOf(a);
+    });
+
+    // 按比例分到的空间超过room的项直接取到最大/最小值，剩余的项都不会超过限制
+    int first = 0;
+    for(; first < n; first++)
+    {
+        const int i = order[first];
+        const qint64 room = roomOf(i);
+        const qint64 weight = weightOf(i);
+        if(room * totalWeight > remain * weight)
+            break;
+        sizes[i] = grow ? maximums[i] : minimums[i];
+        remain -= room;
+        totalWeight -= weight;
+    }
+
+    // 按累计值向下取整分配，保证分配总和与remain完全一致
+    if(first < n && remain > 0)
+    {
+        qint64 accWeight = 0;
+        qint64 given = 0;
+        for(int k = first; k < n; k++)
+        {
+            const int i = order[k];
+            accWeight += weightOf(i);
+            const qint64 target = remain * accWeight / totalWeight;
+            const int add = int(target - given);
+            given = target;
+            sizes[i] += grow ? add : -add;
+        }
+        remain = 0;
+    }
+    return remain;
+}
+
+int AdvancedToolBox::distributeSpace(int *sizes, const int *minimums, const int *maximums, int count, int space, int *order)
+{
+    if(space == 0 || count <= 0)
+        return space;
+
+    const bool grow = space > 0;
+    qint64 remain = grow ? space : -qint64(space);
+
+    int n = 0;
+    for(int i = 0; i < count; i++)
+    {
+        const qint64 room = grow ? qint64(maximums[i]) - sizes[i] : qint64(sizes[i]) - minimums[i];
+        if(room > 0)
+            order[n++] = i;
+    }
+    if(n == 0)
+        return space;
+
+    // 先按当前尺寸的比例分配给尺寸大于0的项，它们全部达到最大/最小值后，剩余的空间平均分配给尺寸为0的项
+    const int weighted = int(std::partition(order, order + n, [=](int i) { return sizes[i] > 0; }) - order);
+    if(weighted > 0)
+        remain = spreadSpace(sizes, minimums, maximums, order, weighted, remain, grow, true);
+    if(remain > 0 && weighted < n)
+        remain = spreadSpace(sizes, minimums, maximums, order + weighted, n - weighted, remain, grow, false);
+    return int(grow ? remain : -remain);
+}
+
 AdvancedToolBox::AdvancedToolBox(QWidget *parent)
     : QWidget(parent)
     , d_ptr(new AdvancedToolBoxPrivate(this))
 {
+    qRegisterMetaType<AdvancedToolBox::Stats>();
     setAcceptDrops(true);
 }
 
@@ -225,6 +1021,9 @@ QSize AdvancedToolBox::sizeHint() const
 QSize AdvancedToolBox::minimumSizeHint() const
 {
     Q_D(const AdvancedToolBox);
+    // 滚动模式下高度由滚动条承担
+    if(d->scrollEnable)
+        return QSize(d->minSizeHint.width() + d->scrollBar->sizeHint().width(), 0);
     return d->minSizeHint;
 }
 
@@ -232,26 +1031,50 @@ void AdvancedToolBox::addWidget(QWidget *widget, const QString &label, const QIc
 {
     Q_D(AdvancedToolBox);
     Q_ASSERT(widget);
+    // model模式下页面与model的行一一对应，不能另外添加
+    if(d->model)
+        return;
     int n = d->items.count();
     d->insertWidgetToList(n, widget, label, icon);
 }
 
+void AdvancedToolBox::addLazyWidget(const WidgetFactory &factory, const QString &label,
+                                    const QSize &estimatedSize, const QIcon &icon)
+{
+    Q_D(AdvancedToolBox);
+    Q_ASSERT(factory);
+    if(d->model)
+        return;
+    int n = d->items.count();
+    d->insertLazyToList(n, factory, estimatedSize, label, icon);
+}
+
+void AdvancedToolBox::setItemSizeProvider(int index, const SizeProvider &provider)
+{
+    Q_D(AdvancedToolBox);
+    if(auto item = d->items.value(index))
+        d->setItemSizeProvider(item, provider);
+}
+
+void AdvancedToolBox::setLazyReleaseTimeout(int msec)
+{
+    Q_D(AdvancedToolBox);
+    d->lazyReleaseTimeout = msec;
+    if(msec >= 0)
+        d->releaseLazyPages();
+}
+
 int AdvancedToolBox::indexOf(QWidget *widget)
 {
     Q_D(AdvancedToolBox);
-    auto &items = d->items;
-    for(int i = 0; i < items.size(); i++)
-    {
-        QWidget *w = items.at(i)->widget;
-        if(w == widget)
-            return i;
-    }
-    return -1;
+    return d->indexOf(widget);
 }
 
 QWidget *AdvancedToolBox::takeIndex(int index)
 {
     Q_D(AdvancedToolBox);
+    if(d->model)
+        return nullptr;
     return d->takeIndex(index);
 }
 
@@ -260,56 +1083,120 @@ QWidget *AdvancedToolBox::widget(int index)
     Q_D(AdvancedToolBox);
     auto item = d->items.value(index);
     if(item)
+    {
+        // 延迟创建的页面此时需要创建出来
+        if(d->materializePage(item))
+        {
+            d->resetSizeHint();
+            d->doLayout();
+        }
         return item->widget;
+    }
     return nullptr;
 }
 
-void AdvancedToolBox::setItemExpand(int index, bool expand)
+int AdvancedToolBox::indexAt(const QPoint &pos) const
 {
-    Q_D(AdvancedToolBox);
-    d->setIndexExpand(index, expand);
+    Q_D(const AdvancedToolBox);
+    if(!rect().contains(pos))
+        return -1;
+    return d->pageAt(pos.y());
 }
 
-void AdvancedToolBox::setItemVisible(int index, bool visible)
+QByteArray AdvancedToolBox::saveState() const
 {
-    Q_D(AdvancedToolBox);
-    d->setIndexVisible(index, visible);
+    Q_D(const AdvancedToolBox);
+    return d->saveState();
 }
 
-void AdvancedToolBox::setItemText(int index, const QString &text)
+bool AdvancedToolBox::restoreState(const QByteArray &state)
 {
     Q_D(AdvancedToolBox);
-    if(auto item = d->items.value(index))
-        item->tabTitle->setText(text);
+    // model模式下顺序由model决定
+    if(d->model)
+        return false;
+    return d->restoreState(state);
 }
 
-void AdvancedToolBox::setItemIcon(int index, const QIcon &icon)
+void AdvancedToolBox::setModel(QAbstractItemModel *model, const PageFactory &factory, const QModelIndex &root)
 {
     Q_D(AdvancedToolBox);
-    if(auto item = d->items.value(index))
-        item->tabTitle->setIcon(icon);
+    d->setModel(model, factory, root);
 }
 
-QString AdvancedToolBox::itemText(int index)
+QAbstractItemModel *AdvancedToolBox::model() const
 {
-    Q_D(AdvancedToolBox);
-    if(auto item = d->items.value(index))
-        return item->title();
-    return QString();
+    Q_D(const AdvancedToolBox);
+    return d->model;
 }
 
-QIcon AdvancedToolBox::itemIcon(int index)
+void AdvancedToolBox::setItemExpand(int index, bool expand)
 {
     Q_D(AdvancedToolBox);
-    if(auto item = d->items.value(index))
-        return item->tabTitle->icon();
-    return QIcon();
+    d->setIndexExpand(index, expand);
 }
 
-int AdvancedToolBox::textIndentation()
+void AdvancedToolBox::setItemVisible(int index, bool visible)
 {
     Q_D(AdvancedToolBox);
-    return d->indent;
+    d->setIndexVisible(index, visible);
+}
+
+void AdvancedToolBox::setItemText(int index, const QString &text)
+{
+    Q_D(AdvancedToolBox);
+    if(auto item = d->items.value(index))
+    {
+        item->text = d->shareText(text);
+        d->titleMenuChanged(true);
+        if(item->tabTitle)
+            item->tabTitle->setText(item->text);
+        else
+            d->updateTitle(item);
+    }
+}
+
+void AdvancedToolBox::setItemIcon(int index, const QIcon &icon)
+{
+    Q_D(AdvancedToolBox);
+    if(auto item = d->items.value(index))
+    {
+        // 图标有无会改变标题高度
+        const bool relayout = item->icon.isNull() != icon.isNull();
+        item->icon = d->shareIcon(icon);
+        if(item->tabTitle)
+            item->tabTitle->setIcon(item->icon);
+        else
+            d->updateTitle(item);
+        if(relayout)
+        {
+            d->markDirty(index, index);
+            d->resetSizeHint();
+            d->doLayout();
+        }
+    }
+}
+
+QString AdvancedToolBox::itemText(int index)
+{
+    Q_D(AdvancedToolBox);
+    if(auto item = d->items.value(index))
+        return item->title();
+    return QString();
+}
+
+QIcon AdvancedToolBox::itemIcon(int index)
+{
+    Q_D(AdvancedToolBox);
+    if(auto item = d->items.value(index))
+        return item->icon;
+    return QIcon();
+}
+
+int AdvancedToolBox::textIndentation()
+{
+    Q_D(AdvancedToolBox);
+    return d->indent;
 }
 
 void AdvancedToolBox::resetTextIndentation(int indent)
@@ -318,6 +1205,76 @@ void AdvancedToolBox::resetTextIndentation(int indent)
     d->setIndentation(indent);
 }
 
+void AdvancedToolBox::setSnapshotAnimationEnable(bool enable)
+{
+    Q_D(AdvancedToolBox);
+    d->snapshotAnimation = enable;
+}
+
+void AdvancedToolBox::setPaintedTitleEnable(bool enable)
+{
+    Q_D(AdvancedToolBox);
+    d->paintedSetting = enable;
+    d->setPaintedTitles(enable || d->scrollEnable);
+}
+
+void AdvancedToolBox::setTitleCacheEnable(bool enable)
+{
+    Q_D(AdvancedToolBox);
+    if(d->titleCacheEnable == enable)
+        return;
+    d->titleCacheEnable = enable;
+    d->updateTitleIndent();
+}
+
+void AdvancedToolBox::setResizeMode(ResizeMode mode)
+{
+    Q_D(AdvancedToolBox);
+    d->resizeMode = mode;
+}
+
+AdvancedToolBox::ResizeMode AdvancedToolBox::resizeMode() const
+{
+    Q_D(const AdvancedToolBox);
+    return d->resizeMode;
+}
+
+void AdvancedToolBox::setStatsEnable(bool enable)
+{
+    Q_D(AdvancedToolBox);
+    d->statsEnable = enable;
+}
+
+AdvancedToolBox::Stats AdvancedToolBox::stats() const
+{
+    Q_D(const AdvancedToolBox);
+    return d->stats;
+}
+
+void AdvancedToolBox::resetStats()
+{
+    Q_D(AdvancedToolBox);
+    d->stats = Stats();
+}
+
+void AdvancedToolBox::addTitleMenuAction(QAction *action)
+{
+    Q_D(AdvancedToolBox);
+    d->ensureTitleMenu();
+    d->titleMenu->addAction(action);
+    d->menuSeparator->setVisible(true);
+}
+
+void AdvancedToolBox::removeTitleMenuAction(QAction *action)
+{
+    Q_D(AdvancedToolBox);
+    if(!d->titleMenu)
+        return;
+    d->titleMenu->removeAction(action);
+    const QList<QAction *> actions = d->titleMenu->actions();
+    d->menuSeparator->setVisible(actions.last() != d->menuSeparator);
+}
+
 void AdvancedToolBox::setDragSortEnable(bool enable)
 {
     Q_D(AdvancedToolBox);
@@ -330,6 +1287,125 @@ void AdvancedToolBox::setAnimationEnable(bool enable)
     d->animationEnable = enable;
 }
 
+void AdvancedToolBox::setVirtualizationEnable(bool enable)
+{
+    Q_D(AdvancedToolBox);
+    d->virtualSetting = enable;
+    d->setVirtualEnable(enable || d->scrollEnable);
+}
+
+void AdvancedToolBox::setScrollEnable(bool enable)
+{
+    Q_D(AdvancedToolBox);
+    d->setScrollEnable(enable);
+}
+
+bool AdvancedToolBox::isScrollEnable() const
+{
+    Q_D(const AdvancedToolBox);
+    return d->scrollEnable;
+}
+
+QScrollBar *AdvancedToolBox::verticalScrollBar() const
+{
+    Q_D(const AdvancedToolBox);
+    return d->scrollBar;
+}
+
+void AdvancedToolBox::scrollToIndex(int index)
+{
+    Q_D(AdvancedToolBox);
+    auto item = d->items.value(index);
+    if(!d->scrollEnable || !item || item->isHidden())
+        return;
+    d->scrollBar->setValue(d->scrollValue + item->titleRect().top() - d->contentRect().top());
+}
+
+void AdvancedToolBox::setSharedResourcesEnable(bool enable)
+{
+    Q_D(AdvancedToolBox);
+    d->setSharedResources(enable);
+}
+
+// QWidget及其私有数据的大致字节数，用于估计AdvancedToolBox创建的子窗口
+static const int EstimatedWidgetBytes = 1024;
+
+AdvancedToolBox::MemoryReport AdvancedToolBox::memoryReport() const
+{
+    Q_D(const AdvancedToolBox);
+    MemoryReport report;
+    report.pageCount = d->items.count();
+    report.itemBytes = qint64(report.pageCount) * qint64(sizeof(AdvancedToolBoxPrivate::ToolBoxItem));
+    // 共用的字符串和图标只计一次
+    QSet<const void *> texts;
+    QSet<qint64> icons;
+    const ToolBoxSharedPool &pool = ToolBoxSharedPool::instance();
+    for(auto item : d->items)
+    {
+        if(item->extra)
+            report.itemBytes += qint64(sizeof(AdvancedToolBoxPrivate::ToolBoxItem::Extra));
+        report.widgetCount += (item->tabTitle ? 1 : 0) + (item->handle ? 1 : 0) + (item->tabContainer ? 1 : 0);
+        if(!item->text.isEmpty() && !texts.contains(item->text.constData()))
+        {
+            texts.insert(item->text.constData());
+            report.textBytes += qint64(item->text.capacity()) * qint64(sizeof(QChar)) + qint64(sizeof(QString::Data));
+        }
+        if(!item->icon.isNull() && !icons.contains(item->icon.cacheKey()))
+        {
+            icons.insert(item->icon.cacheKey());
+            report.iconBytes += pool.iconBytes(item->icon);
+        }
+    }
+    report.widgetCount += d->containerPool.count();
+    report.widgetBytes = qint64(report.widgetCount) * EstimatedWidgetBytes;
+    return report;
+}
+
+void AdvancedToolBox::setSuspendCollapsedPages(bool enable)
+{
+    Q_D(AdvancedToolBox);
+    d->setSuspendCollapsed(enable);
+}
+
+void AdvancedToolBox::setDeferredLayoutEnable(bool enable)
+{
+    Q_D(AdvancedToolBox);
+    d->deferredLayout = enable;
+}
+
+void AdvancedToolBox::populate(const PageGenerator &generator, int total, int frameBudget)
+{
+    Q_D(AdvancedToolBox);
+    if(d->model)
+        return;
+    d->populate(generator, total, frameBudget);
+}
+
+void AdvancedToolBox::cancelPopulate()
+{
+    Q_D(AdvancedToolBox);
+    if(d->populateGenerator)
+        d->finishPopulate(true);
+}
+
+bool AdvancedToolBox::isPopulating() const
+{
+    Q_D(const AdvancedToolBox);
+    return bool(d->populateGenerator);
+}
+
+void AdvancedToolBox::beginUpdate()
+{
+    Q_D(AdvancedToolBox);
+    d->beginUpdate();
+}
+
+void AdvancedToolBox::endUpdate()
+{
+    Q_D(AdvancedToolBox);
+    d->endUpdate();
+}
+
 bool AdvancedToolBox::event(QEvent *e)
 {
     bool ret = QWidget::event(e);
@@ -338,29 +1414,50 @@ bool AdvancedToolBox::event(QEvent *e)
         case QEvent::LayoutRequest:
         {
             Q_D(AdvancedToolBox);
-            for(auto item : d->items)
-                item->calItemSize();
-            d->resetSizeHint();
-            d->doLayout();
+            d->layoutRequestEvent();
         }
         break;
         case QEvent::StyleChange:
         {
             Q_D(AdvancedToolBox);
-            int old = d->handleWidth;
+            d->titleStyleSerial = nextTitleStyleSerial();
             d->styleChangedEvent();
             d->updateTitleIndent();
-            if(old != d->handleWidth)
-            {
-                d->resetSizeHint();
-                d->doLayout();
-            }
+            // 子窗口的样式先于AdvancedToolBox更新，这里统一重新计算标题尺寸并布局
+            d->titleMetricsChanged();
+        }
+        break;
+        case QEvent::FontChange:
+        {
+            Q_D(AdvancedToolBox);
+            d->titleStyleSerial = nextTitleStyleSerial();
+            d->titleMetricsChanged();
+        }
+        break;
+        case QEvent::PaletteChange:
+        {
+            Q_D(AdvancedToolBox);
+            d->titleStyleSerial = nextTitleStyleSerial();
         }
         break;
         case QEvent::Resize:
         {
             Q_D(AdvancedToolBox);
-            d->doLayout();
+            d->doLayout(true);
+        }
+        break;
+        case QEvent::Move:
+        case QEvent::Show:
+        {
+            Q_D(AdvancedToolBox);
+            d->updateVirtualPages();
+            d->scheduleLazyPages();
+        }
+        break;
+        case QEvent::ParentChange:
+        {
+            Q_D(AdvancedToolBox);
+            d->watchViewport();
         }
         break;
         default:
@@ -381,23 +1478,85 @@ void AdvancedToolBox::paintEvent(QPaintEvent *event)
     opt.state |= QStyle::State_Horizontal;
     opt.palette = this->palette();
 
-    bool first = true;
     QPainter painter(this);
-    for(auto item : d->items)
+    const QRect clip = event->rect();
+    // 只绘制与重绘区域相交的页面，动画过程中span还没有更新，检查所有页面
+    const bool animating = d->isAnimationState;
+    int from = 0;
+    bool first = true;
+    if(!animating)
+    {
+        const int span = d->spanAt(clip.top());
+        if(span < 0)
+            return;
+        from = d->spanIndex.at(span);
+        first = span == 0;
+    }
+    for(int i = from; i < d->items.count(); i++)
     {
-        if(item->widget->isHidden())
+        auto item = d->items.at(i);
+        if(item->isHidden())
             continue;
 
+        const QRect title = item->titleRect();
+        if(!animating && title.top() - hw > clip.bottom())
+            break;
         if(!first)
         {
-            int top = item->tabTitle->pos().y();
-            opt.rect = QRect(0, top - hw, this->width(), hw);
+            opt.rect = QRect(0, title.top() - hw, this->width(), hw);
             this->style()->drawPrimitive(QStyle::PE_IndicatorDockWidgetResizeHandle, &opt, &painter, this);
         }
+        if(d->paintedTitles && title.intersects(clip))
+            d->paintTitle(&painter, item);
         first = false;
     }
 }
 
+void AdvancedToolBox::wheelEvent(QWheelEvent *event)
+{
+    Q_D(AdvancedToolBox);
+    if(d->scrollEnable && d->scrollBar->isVisibleTo(this))
+        QCoreApplication::sendEvent(d->scrollBar, event);
+    else
+        QWidget::wheelEvent(event);
+}
+
+void AdvancedToolBox::mousePressEvent(QMouseEvent *event)
+{
+    Q_D(AdvancedToolBox);
+    if(!d->paintedTitles || !d->titleMousePress(event))
+        QWidget::mousePressEvent(event);
+}
+
+void AdvancedToolBox::mouseMoveEvent(QMouseEvent *event)
+{
+    Q_D(AdvancedToolBox);
+    if(!d->paintedTitles || !d->titleMouseMove(event))
+        QWidget::mouseMoveEvent(event);
+}
+
+void AdvancedToolBox::mouseReleaseEvent(QMouseEvent *event)
+{
+    Q_D(AdvancedToolBox);
+    if(!d->paintedTitles || !d->titleMouseRelease(event))
+        QWidget::mouseReleaseEvent(event);
+}
+
+void AdvancedToolBox::contextMenuEvent(QContextMenuEvent *event)
+{
+    Q_D(AdvancedToolBox);
+    if(!d->paintedTitles || !d->titleContextMenu(event))
+        QWidget::contextMenuEvent(event);
+}
+
+void AdvancedToolBox::leaveEvent(QEvent *event)
+{
+    Q_D(AdvancedToolBox);
+    if(d->paintedTitles && !d->pressItem)
+        d->setHover(QPoint(-1, -1));
+    QWidget::leaveEvent(event);
+}
+
 void AdvancedToolBox::dragEnterEvent(QDragEnterEvent *event)
 {
     const QMimeData *data = event->mimeData();
@@ -422,42 +1581,29 @@ void AdvancedToolBox::dragMoveEvent(QDragMoveEvent *event)
         return;
     }
 
-    auto &items = d->items;
     const int y = event->pos().y();
-    int hover = -1;
+    const int hover = d->pageAt(y);
     QRect rubber_rect;
-    for(int i = 0; i < items.count(); i++)
+    if(hover >= 0)
     {
-        auto *item = items.at(i);
-        if(item->isHidden())
-            continue;
+        auto *item = d->items.at(hover);
         if(item->expanded())
         {
-            QRect cr = item->tabContainer->geometry();
-            if(cr.bottom() >= y)
-            {
-                hover = i;
-                QRect tr = item->tabTitle->geometry();
-                int mid = (tr.top() + cr.bottom() + 1) / 2;
-                int top = mid < y ? mid : tr.top();
-                rubber_rect = QRect(tr.x(), top, tr.width(), 0);
-                rubber_rect.setBottom(mid < y ? cr.bottom() : mid);
-                break;
-            }
+            QRect cr = item->geometry;
+            QRect tr = item->titleRect();
+            int mid = (tr.top() + cr.bottom() + 1) / 2;
+            int top = mid < y ? mid : tr.top();
+            rubber_rect = QRect(tr.x(), top, tr.width(), 0);
+            rubber_rect.setBottom(mid < y ? cr.bottom() : mid);
         }
         else
         {
-            QRect r = item->tabTitle->geometry();
-            if(r.bottom() >= y)
-            {
-                hover = i;
-                int mid = r.center().y();
-                int top = mid < y ? r.bottom() + 1 : r.top() - d->handleWidth;
-                rubber_rect = QRect(r.x(), top, r.width(), d->handleWidth);
-                if(d->handleWidth <= 1)
-                    rubber_rect.adjust(0, -2, 0, 2);
-                break;
-            }
+            QRect r = item->titleRect();
+            int mid = r.center().y();
+            int top = mid < y ? r.bottom() + 1 : r.top() - d->handleWidth;
+            rubber_rect = QRect(r.x(), top, r.width(), d->handleWidth);
+            if(d->handleWidth <= 1)
+                rubber_rect.adjust(0, -2, 0, 2);
         }
     }
 
@@ -486,43 +1632,32 @@ void AdvancedToolBox::dropEvent(QDropEvent *event)
         return;
     }
 
-    auto &items = d->items;
     const int y = event->pos().y();
+    const int hover = d->pageAt(y);
     int target = -1;
-    for(int i = 0; i < items.count(); i++)
+    if(hover >= 0)
     {
-        auto *item = items.at(i);
-        if(!item->isHidden())
-        {
-            if(item->expanded())
-            {
-                QRect cr = item->tabContainer->geometry();
-                if(cr.bottom() >= y)
-                {
-                    QRect tr = item->tabTitle->geometry();
-                    int mid = (tr.top() + cr.bottom() + 1) / 2;
-                    target = i + (mid < y ? 1 : 0);
-                    target -= target > drag_index ? 1 : 0;
-                    break;
-                }
-            }
-            else
-            {
-                QRect r = item->tabTitle->geometry();
-                if(r.bottom() >= y)
-                {
-                    target = i + (r.center().y() < y ? 1 : 0);
-                    target -= target > drag_index ? 1 : 0;
-                    break;
-                }
-            }
-        }
+        auto *item = d->items.at(hover);
+        QRect tr = item->titleRect();
+        int mid = item->expanded() ? (tr.top() + item->geometry.bottom() + 1) / 2 : tr.center().y();
+        target = hover + (mid < y ? 1 : 0);
+        target -= target > drag_index ? 1 : 0;
     }
 
-    if(target >= 0 && target != drag_index)
+    if(target >= 0 && target != drag_index && d->model)
+    {
+        // model模式下由model移动行，页面在rowsMoved中跟随移动
+        const int row = target > drag_index ? target + 1 : target;
+        if(d->model->moveRow(d->modelRoot, drag_index, d->modelRoot, row))
+            event->acceptProposedAction();
+        else
+            event->ignore();
+    }
+    else if(target >= 0 && target != drag_index)
     {
         event->acceptProposedAction();
         d->items.move(drag_index, target);
+        d->markPagesDirty(qMin(drag_index, target));
         d->resetPages();
         d->updateGeometries();
     }
@@ -551,8 +1686,8 @@ void AdvancedToolBox::startDrag(int index, const QPoint &gpos)
 
         Q_D(AdvancedToolBox);
         auto item = d->items.at(index);
-        QPixmap pix = item->tabTitle->grab();
-        QPoint pos = item->tabTitle->mapFromGlobal(gpos);
+        QPixmap pix = d->grabTitle(item);
+        QPoint pos = mapFromGlobal(gpos) - item->titleRect().topLeft();
         drag.setHotSpot(pos);
         drag.setPixmap(pix);
 
@@ -561,25 +1696,65 @@ void AdvancedToolBox::startDrag(int index, const QPoint &gpos)
 }
 
 QWidget *AdvancedToolBoxPrivate::takeIndex(int index)
+{
+    ToolBoxItem *item = items.value(index);
+    if(!item)
+        return nullptr;
+
+    // 还未创建的延迟页面先创建出来，调用者总能拿到页面的widget
+    materializePage(item);
+    QWidget *ret = removeItem(index);
+    resetSizeHint();
+    doLayout();
+    return ret;
+}
+
+// 移除页面，不做布局
+QWidget *AdvancedToolBoxPrivate::removeItem(int index)
 {
     Q_Q(AdvancedToolBox);
     ToolBoxItem *item = items.value(index);
-    if(item)
+    if(!item)
+        return nullptr;
+
+    QWidget *ret = item->widget;
+    if(ret)
     {
-        QWidget *ret = item->widget;
-        if(ret)
-        {
-            ret->setVisible(false);
-            ret->setParent(q);
-        }
+        QObject::disconnect(ret, &QWidget::destroyed, this, &AdvancedToolBoxPrivate::widgetDestroyed);
+        widgetItems.remove(ret);
+        ret->setVisible(false);
+        // 暂停的页面关闭了更新，交还给调用者前恢复
+        if(item->suspended)
+            ret->setUpdatesEnabled(true);
+        ret->setParent(q);
+    }
+    items.removeAt(index);
+    if(item->isLazy())
+        lazyCount--;
+    for(int i = animatedPages.count() - 1; i >= 0; i--)
+    {
+        if(animatedPages.at(i).item == item)
+            animatedPages.remove(i);
+    }
+    boundItems.removeOne(item);
+    if(item == hoverItem)
+        hoverItem = nullptr;
+    if(item == pressItem)
+        pressItem = nullptr;
+    if(item == menuItem)
+        menuItem = nullptr;
+    if(item == stickyItem)
+        stickyItem = nullptr;
+    suspendQueue.removeOne(item);
+    if(item->tabTitle)
         item->tabTitle->deleteLater();
+    if(item->tabContainer)
         item->tabContainer->deleteLater();
+    if(item->handle)
         item->handle->deleteLater();
-        delete item;
-        doLayout();
-        return ret;
-    }
-    return nullptr;
+    delete item;
+    markPagesDirty(index);
+    return ret;
 }
 
 void AdvancedToolBoxPrivate::setIndexExpand(int index, bool expand)
@@ -588,33 +1763,159 @@ void AdvancedToolBoxPrivate::setIndexExpand(int index, bool expand)
     if(item && item->expanded() != expand)
     {
         item->isExpanded = expand;
+        if(expand)
+        {
+            // 先创建延迟页面，使得展开时能按照实际尺寸布局
+            item->resetCollapsedTime();
+            if(materializePage(item))
+                resetSizeHint();
+        }
+        else
+        {
+            pageCollapsed(item);
+        }
+        const bool shownChanged = updatePageShown(item);
         expandStateChanged(index, expand);
+        notifyPageState(index, true, shownChanged);
     }
 }
 
+// 更新页面内容的显示状态（展开且未隐藏），并按策略挂起或恢复widget，返回状态是否变化
+bool AdvancedToolBoxPrivate::updatePageShown(ToolBoxItem *item)
+{
+    const bool shown = item->isExpanded && !item->hidden;
+    if(shown == item->shown)
+        return false;
+
+    item->shown = shown;
+    if(suspendCollapsed)
+    {
+        // 恢复要在展开动画之前，挂起要等到折叠动画结束
+        if(shown)
+            resumePage(item);
+        else if(!suspendQueue.contains(item))
+            suspendQueue.append(item);
+    }
+    return true;
+}
+
+// 展开折叠和内容显示状态的信号都从这里发送，状态已经更新完毕
+void AdvancedToolBoxPrivate::notifyPageState(int index, bool expandChanged, bool shownChanged)
+{
+    Q_Q(AdvancedToolBox);
+    auto item = items.value(index);
+    if(!item)
+        return;
+    const bool expanded = item->isExpanded;
+    const bool shown = item->shown;
+    if(expandChanged)
+    {
+        if(expanded)
+            emit q->itemExpanded(index);
+        else
+            emit q->itemCollapsed(index);
+    }
+    if(shownChanged)
+    {
+        if(shown)
+            emit q->pageShown(index);
+        else
+            emit q->pageHidden(index);
+    }
+}
+
+void AdvancedToolBoxPrivate::setSuspendCollapsed(bool enable)
+{
+    if(suspendCollapsed == enable)
+        return;
+
+    suspendCollapsed = enable;
+    suspendQueue.clear();
+    for(auto item : items)
+    {
+        if(enable && !item->shown)
+            suspendPage(item);
+        else if(!enable)
+            resumePage(item);
+    }
+}
+
+// 真正隐藏widget，页面中的定时器、动画等可以在hideEvent中暂停
+void AdvancedToolBoxPrivate::suspendPage(ToolBoxItem *item)
+{
+    if(item->suspended)
+        return;
+    item->suspended = true;
+    if(QWidget *widget = item->widget)
+    {
+        widget->hide();
+        widget->setUpdatesEnabled(false);
+    }
+}
+
+void AdvancedToolBoxPrivate::resumePage(ToolBoxItem *item)
+{
+    if(!item->suspended)
+        return;
+    item->suspended = false;
+    if(QWidget *widget = item->widget)
+    {
+        widget->setUpdatesEnabled(true);
+        widget->setVisible(item->widgetVisible());
+        // 隐藏期间QWidgetItem返回的尺寸为0，需要重新计算
+        calItemSize(item);
+    }
+}
+
+void AdvancedToolBoxPrivate::suspendQueuedPages()
+{
+    for(auto item : suspendQueue)
+    {
+        if(!item->shown)
+            suspendPage(item);
+    }
+    suspendQueue.clear();
+}
+
 void AdvancedToolBoxPrivate::setIndexVisible(int index, bool visible)
 {
     auto item = items.value(index);
     if(!item)
         return;
 
-    if((item->widget->isHidden() && !visible) || !item->widget->isHidden() && visible)
+    if(item->hidden == !visible)
         return;
 
-    item->widget->setVisible(visible);
-    item->tabTitle->setVisible(visible);
-    item->tabContainer->setVisible(visible);
+    item->hidden = !visible;
+    if(item->widget)
+        item->widget->setVisible(item->widgetVisible());
+    if(item->tabTitle)
+        item->tabTitle->setVisible(visible);
+    if(item->tabContainer)
+        item->tabContainer->setVisible(visible);
+    markPagesDirty(index, false);
 
     if(!visible && item->isExpanded)
         item->manualHeight = item->layoutHeight;
+    const bool shownChanged = updatePageShown(item);
 
     resetSizeHint();
 
     if(visible)
+    {
         resetManualSize();
+        item->resetCollapsedTime();
+        scheduleLazyPages();
+    }
+    else
+    {
+        pageCollapsed(item);
+    }
 
     // 这里选择重新布局，可以考虑尽可能维持该页面后布局，提升体验
     doLayout();
+    if(shownChanged)
+        notifyPageState(index, false, true);
 }
 
 void AdvancedToolBoxPrivate::styleChangedEvent()
@@ -639,17 +1940,18 @@ void AdvancedToolBoxPrivate::setIndentation(int i)
 
 void AdvancedToolBoxPrivate::insertWidgetToList(int index, QWidget *widget, const QString &label, const QIcon &icon)
 {
-    Q_Q(AdvancedToolBox);
     int count = items.count();
     if(index < 0 || index > count)
         index = count;
 
-    int old_index = q->indexOf(widget);
+    int old_index = indexOf(widget);
     if(old_index >= 0) // just move
     {
+        index = qMin(index, count - 1);
         if(index != old_index)
         {
             items.move(old_index, index);
+            markPagesDirty(qMin(old_index, index));
             resetPages();
             updateGeometries();
         }
@@ -658,129 +1960,186 @@ void AdvancedToolBoxPrivate::insertWidgetToList(int index, QWidget *widget, cons
     {
         bool show = !(widget->isHidden() && widget->testAttribute(Qt::WA_WState_ExplicitShowHide));
 
-        ToolBoxItem *item = new ToolBoxItem();
-        item->tabContainer = new ToolBoxPageContainer(q);
-        widget->setParent(item->tabContainer);
+        ToolBoxItem *item = createItem(index, label, icon);
+        // 虚拟化模式下，等到页面进入可见区域时再放入容器
+        widget->setParent(item->tabContainer ? item->tabContainer : ensureParkingLot());
         widget->move(QPoint(0, 0));
         item->widget = widget;
-        item->tabTitle = createTitle(label, icon);
-        item->handle = createHandle();
-        item->isExpanded = true;
-        items.insert(index, item);
+        widgetItems.insert(widget, item);
+        item->hidden = !show;
+        item->shown = show;
         if(show)
             widget->show();
 
-        item->calItemSize();
+        calItemSize(item);
         resetSizeHint();
         connect(widget, &QWidget::destroyed, this, &AdvancedToolBoxPrivate::widgetDestroyed);
         doLayout();
     }
 }
 
-void AdvancedToolBoxPrivate::doLayout()
+void AdvancedToolBoxPrivate::insertLazyToList(int index, const AdvancedToolBox::WidgetFactory &factory, const QSize &estimate,
+                                              const QString &label, const QIcon &icon)
+{
+    int count = items.count();
+    if(index < 0 || index > count)
+        index = count;
+
+    ToolBoxItem *item = createItem(index, label, icon);
+    ToolBoxItem::Extra *extra = item->ensureExtra();
+    extra->factory = factory;
+    extra->estimate = estimate;
+    lazyCount++;
+
+    calItemSize(item);
+    resetSizeHint();
+    doLayout();
+    scheduleLazyPages();
+}
+
+AdToolBoxItem *AdvancedToolBoxPrivate::createItem(int index, const QString &label, const QIcon &icon)
+{
+    Q_Q(AdvancedToolBox);
+    ToolBoxItem *item = new ToolBoxItem();
+    item->id = nextItemId++;
+    item->index = index;
+    item->text = shareText(label);
+    item->icon = shareIcon(icon);
+    if(!virtualEnable)
+    {
+        item->tabContainer = new ToolBoxPageContainer(q);
+        if(paintedTitles)
+            item->tabContainer->installEventFilter(this);
+    }
+    if(!paintedTitles)
+    {
+        item->tabTitle = createTitle(item->text, item->icon);
+        item->handle = createHandle();
+    }
+    item->isExpanded = true;
+    items.insert(index, item);
+    markPagesDirty(index);
+    return item;
+}
+
+// 处理LayoutRequest，只重新计算子窗口请求过布局的页面尺寸
+void AdvancedToolBoxPrivate::layoutRequestEvent()
+{
+    layoutRequested = false;
+    for(auto item : items)
+    {
+        ToolBoxPageContainer *container = item->tabContainer;
+        if(container && container->sizeDirty)
+        {
+            container->sizeDirty = false;
+            calItemSize(item);
+        }
+    }
+    resetSizeHint();
+    doLayout(true);
+}
+
+void AdvancedToolBoxPrivate::requestLayout()
+{
+    if(layoutRequested)
+        return;
+    Q_Q(AdvancedToolBox);
+    layoutRequested = true;
+    QCoreApplication::postEvent(q, new QEvent(QEvent::LayoutRequest));
+}
+
+// force为false时，延迟布局模式下只发送LayoutRequest，在下一次事件循环中统一布局
+void AdvancedToolBoxPrivate::doLayout(bool force)
 {
     Q_Q(AdvancedToolBox);
+    if(updateDepth > 0)
+    {
+        pendingLayout = true;
+        return;
+    }
+    if(deferredLayout && !force)
+    {
+        requestLayout();
+        return;
+    }
     if(!q->testAttribute(Qt::WA_Resized))
         return;
-        
-    resetPages();
+    TOOLBOX_STATS_SCOPE(this, layout);
+
+    if(pagesDirtyFrom < items.count())
+        resetPages();
+    markDirty(0, items.count() - 1);
 
     int space  = 0;
-    QVector<ToolBoxItem *> expandedItems;
+    int layoutCount = 0;
+    reserveLayout(items.count());
     {
         int totalSize = 0;
         for(auto item : items)
         {
-            if(item->widget->isHidden())
+            if(item->isHidden())
                 continue;
 
-            if(item->expanded())
-                expandedItems.append(item);
-
             item->layoutHeight = item->expanded() ? item->preferHeight() : 0;
-            totalSize += item->tabTitle->sizeHint().height(); // title height
+            if(item->expanded())
+            {
+                layoutItems[layoutCount] = item;
+                layoutSizes[layoutCount] = item->layoutHeight;
+                layoutMins[layoutCount] = item->minSize.height();
+                layoutMaxs[layoutCount] = item->maxSize.height();
+                layoutCount++;
+            }
+            totalSize += titleHeight(item); // title height
             totalSize += item->layoutHeight;
             totalSize += handleWidth;
         }
         // handle 要少一个
         totalSize -= (totalSize > 0 ?  handleWidth : 0);
         space = q->rect().height() - totalSize;
-    }
-
-    if(space != 0)
-    {
-        int space2 = space;
-        int viewsSize = 0;
-        auto it = expandedItems.begin();
-        while(it != expandedItems.end())
+        // 滚动模式下页面保持建议高度，超出的部分通过滚动查看，只在有空余时扩展页面
+        if(scrollEnable)
         {
-            ToolBoxItem *item = *it;
-            if((space > 0 && item->layoutHeight >= item->maxSize.height()) ||
-               (space < 0 && item->layoutHeight <= item->minSize.height()))
-            {
-                // remove fix size
-                it = expandedItems.erase(it);
-            }
-            else
-            {
-                viewsSize += item->layoutHeight;
-                it++;
-            }
+            scrollBar->setVisible(space < 0);
+            placeScrollBar();
+            space = qMax(space, 0);
         }
+    }
 
-        // 目前默认按照初始窗口当前尺寸来按比例分配空间
-        // viewsSize变为0, 则认为layoutHeight都因为某些原因为0（不存在布局等）
-        // 此时平均分配
-        auto calcAddSize = [&viewsSize, &expandedItems](int curr, int space){
-            if(viewsSize <= 0)
-                return qCeil(qreal(space) / expandedItems.count());
-            else
-                return qCeil(qreal(space) * curr / viewsSize);
-        };
-
-        // 空间不足或者有空余时，调整可伸缩的窗口，按照上一次手动调整后的比例，分配或者压缩空间
-        // 先尝试按比例分配空间，超过最大、最小的先处理掉。
-        bool done = false;
-        while(!expandedItems.isEmpty() && !done)
-        {
-            done = true;
-            auto it = expandedItems.begin();
-            while(it != expandedItems.end())
-            {
-                ToolBoxItem *item = *it;
-                int prefer = item->layoutHeight + calcAddSize(item->layoutHeight, space2);
-
-                if((space > 0 && prefer > item->maxSize.height()) || (space < 0 && prefer < item->minSize.height()))
-                {
-                    int threshold = space > 0 ? item->maxSize.height() : item->minSize.height();
-                    space2 -= (threshold - item->layoutHeight);
-                    viewsSize -= item->layoutHeight;
-                    item->layoutHeight = threshold;
-                    expandedItems.erase(it);
-                    done = false;
-                    break;
-                }
-                it++;
-            }
-        }
-        for(ToolBoxItem *item : expandedItems)
-        {
-            int add =  calcAddSize(item->layoutHeight, space2);
-            viewsSize -= item->layoutHeight;
-            space2 -= add;
-            item->layoutHeight += add;
-        }
+    // 空间不足或者有空余时，调整可伸缩的窗口，按照上一次手动调整后的比例，分配或者压缩空间
+    if(space != 0 && layoutCount > 0)
+    {
+        AdvancedToolBox::distributeSpace(layoutSizes.data(), layoutMins.constData(), layoutMaxs.constData(),
+                                         layoutCount, space, layoutOrder.data());
+        for(int i = 0; i < layoutCount; i++)
+            layoutItems.at(i)->layoutHeight = layoutSizes.at(i);
     }
     updateGeometries();
 }
 
+// 布局数组按页面数增长，成倍扩容，页面减少时保留容量
+void AdvancedToolBoxPrivate::reserveLayout(int count)
+{
+    if(layoutItems.size() >= count)
+        return;
+    count = qMax(count, layoutItems.size() * 2);
+    layoutItems.resize(count);
+    layoutSizes.resize(count);
+    layoutMins.resize(count);
+    layoutMaxs.resize(count);
+    layoutOrder.resize(count);
+}
+
 void AdvancedToolBoxPrivate::expandStateChanged(int index, bool expand)
 {
     ToolBoxItem *curr = items.value(index);
     if(!curr)
         return;
 
-    curr->tabTitle->setExpanded(expand);
+    if(curr->tabTitle)
+        curr->tabTitle->setExpanded(expand);
+    else
+        updateTitle(curr);
+    markDirty(index, index);
     if(expand)
     {
         int target = curr->preferHeight();
@@ -790,6 +2149,10 @@ void AdvancedToolBoxPrivate::expandStateChanged(int index, bool expand)
             target += space;
             curr->layoutHeight = qMin(target, curr->maxSize.height());
         }
+        else if(scrollEnable)
+        {
+            curr->layoutHeight = target;
+        }
         else
         {
             space = -space;
@@ -800,6 +2163,8 @@ void AdvancedToolBoxPrivate::expandStateChanged(int index, bool expand)
                 if(item->canResize() && i != index) // 暂时忽略当前page
                 {
                     int diff = qMin(item->layoutHeight - item->minSize.height(), space);
+                    if(diff != 0)
+                        markDirty(i, i);
                     item->layoutHeight -= diff;
                     space -= diff;
                 }
@@ -826,343 +2191,2085 @@ void AdvancedToolBoxPrivate::expandStateChanged(int index, bool expand)
                 if(item->canResize())
                 {
                     int diff = qMin(item->maxSize.height() - item->layoutHeight, space);
+                    if(diff != 0)
+                        markDirty(i, i);
                     item->layoutHeight += diff;
                     space -= diff;
                 }
             }
         }
     }
-
-    curr->freezeTarget = true;
-    updateGeometries(animationEnable);
-    resetManualSize();
+
+    curr->freezeTarget = true;
+    updateGeometries(animationEnable);
+    resetManualSize();
+}
+
+// handle实际能够移动的距离，受上下页面最小、最大尺寸的限制，按下时的布局为基准
+int AdvancedToolBoxPrivate::handleLimit(int index, int distance) const
+{
+    const int count = items.count();
+    const int need = qAbs(distance);
+    const bool down = distance > 0;
+
+    // 可调整的空间，满足need后即停止
+    auto capacity = [&](int begin, int step, bool expand) -> int {
+        int total = 0;
+        for(int i = begin; i >= 0 && i < count && total < need; i += step)
+        {
+            auto item = items.at(i);
+            if(!item->canResize())
+                continue;
+            int r = expand ? item->maxSize.height() - item->manualHeight
+                           : item->manualHeight - item->minSize.height();
+            total += qMax(r, 0);
+        }
+        return total;
+    };
+
+    const int shrink = capacity(down ? index : index - 1, down ? 1 : -1, false);
+    const int expand = capacity(down ? index - 1 : index, down ? -1 : 1, true);
+    const int moved = qMin(need, qMin(shrink, expand));
+    return down ? moved : -moved;
+}
+
+void AdvancedToolBoxPrivate::handlePressed(int index)
+{
+    resetManualSize();
+    handleIndex = index;
+    handleDistance = 0;
+}
+
+// 按照resizeMode处理handle拖动：直接调整、只显示预览或者按刷新频率合并
+void AdvancedToolBoxPrivate::handleMoved(int index, int distance)
+{
+    handleIndex = index;
+    handleDistance = distance;
+    switch(resizeMode)
+    {
+        case AdvancedToolBox::OpaqueResize:
+            moveHandle(index, distance);
+            break;
+        case AdvancedToolBox::PreviewResize:
+        {
+            ToolBoxItem *item = items.value(index);
+            if(!item)
+                break;
+            if(!resizeRubber)
+            {
+                Q_Q(AdvancedToolBox);
+                resizeRubber = new QRubberBand(QRubberBand::Line, q);
+            }
+            QRect rect = item->handleRect(handleWidth).translated(0, handleLimit(index, distance));
+            if(rect.height() < 3)
+                rect.adjust(0, -1, 0, 1);
+            resizeRubber->setGeometry(rect);
+            resizeRubber->show();
+        }
+        break;
+        case AdvancedToolBox::ThrottledResize:
+            if(!resizeTimer)
+            {
+                resizeTimer = new QTimer(this);
+                resizeTimer->setSingleShot(true);
+                resizeTimer->setInterval(16);
+                connect(resizeTimer, &QTimer::timeout, this, [this]() {
+                    moveHandle(handleIndex, handleDistance);
+                });
+            }
+            if(!resizeTimer->isActive())
+                resizeTimer->start();
+            break;
+    }
+}
+
+// 松开时提交预览或尚未执行的移动
+void AdvancedToolBoxPrivate::handleReleased()
+{
+    // 无论是否移动过，释放时都结束预览和节流
+    const bool pending = resizeMode == AdvancedToolBox::PreviewResize ||
+                         (resizeTimer && resizeTimer->isActive());
+    if(resizeTimer)
+        resizeTimer->stop();
+    if(resizeRubber)
+        resizeRubber->hide();
+    if(pending && handleIndex >= 0 && handleDistance != 0)
+        moveHandle(handleIndex, handleDistance);
+    handleIndex = -1;
+    handleDistance = 0;
+    resetManualSize();
+}
+
+void AdvancedToolBoxPrivate::moveHandle(int index, int distance)
+{
+    // adjectHandle入口在鼠标移动事件，当鼠标按下时，resetManualSize将当前布局存储
+    // 先恢复上一次移动修改过的页面，只处理受影响的范围
+    const int count = items.count();
+    for(int i = dragFirst; i <= qMin(dragLast, count - 1); i++)
+    {
+        auto item = items.at(i);
+        if(item->canResize() && item->layoutHeight != item->manualHeight)
+        {
+            item->layoutHeight = item->manualHeight;
+            markDirty(i, i);
+        }
+    }
+    dragFirst = INT_MAX;
+    dragLast = -1;
+
+    // handle上方的页面从index - 1向前，下方的页面从index向后
+    // 向下移动时下方页面收缩、上方页面扩展，向上移动则相反
+    const bool down = distance > 0;
+    const int shrinkBegin = down ? index : index - 1;
+    const int shrinkStep = down ? 1 : -1;
+    const int expandBegin = down ? index - 1 : index;
+    const int expandStep = down ? -1 : 1;
+
+    auto room = [](ToolBoxItem *item, bool expand) -> int {
+        int r = expand ? item->maxSize.height() - item->manualHeight
+                       : item->manualHeight - item->minSize.height();
+        return qMax(r, 0);
+    };
+
+    const int moved = qAbs(handleLimit(index, distance));
+
+    auto apply = [&](int begin, int step, bool expand) {
+        int space = moved;
+        for(int i = begin; i >= 0 && i < count && space > 0; i += step)
+        {
+            auto item = items.at(i);
+            if(!item->canResize())
+                continue;
+            int diff = qMin(room(item, expand), space);
+            if(diff == 0)
+                continue;
+            item->layoutHeight = item->manualHeight + (expand ? diff : -diff);
+            space -= diff;
+            markDirty(i, i);
+            dragFirst = qMin(dragFirst, i);
+            dragLast = qMax(dragLast, i);
+        }
+    };
+
+    if(moved > 0)
+    {
+        apply(shrinkBegin, shrinkStep, false);
+        apply(expandBegin, expandStep, true);
+    }
+    updateGeometries(false, true);
+}
+
+// 根据计算好的布局，设置窗口位置等
+// 只从第一个变化的页面开始处理，超出变化范围且位置不变时，后续页面不再处理
+// moveOnly为true时只有页面高度和位置变化（拖动handle），页面的显示状态和尺寸限制不变
+void AdvancedToolBoxPrivate::updateGeometries(bool animate, bool moveOnly)
+{
+    Q_Q(AdvancedToolBox);
+    if(updateDepth > 0)
+    {
+        pendingGeometries = true;
+        return;
+    }
+    animate = animate && q->isVisible();
+    if(isAnimationState)
+    {
+        nextIsAnimation = animate;
+        return;
+    }
+    TOOLBOX_STATS_SCOPE(this, geometryUpdate);
+
+    if(pagesDirtyFrom < items.count())
+        resetPages();
+
+    const int hw = handleWidth;
+    const int count = items.count();
+    QRect cr = contentRect();
+    if(cr.width() != layoutWidth)
+    {
+        layoutWidth = cr.width();
+        markDirty(0, count - 1);
+    }
+
+    int x = cr.left(), offset = cr.top() - scrollValue, width = cr.width();
+    bool first = true;
+    const QRect area = virtualEnable ? viewportRect() : QRect();
+    const int from = qMin(dirtyFirst, count);
+    for(int i = from - 1; i >= 0; i--)
+    {
+        auto prev = items.at(i);
+        if(!prev->isHidden())
+        {
+            offset = prev->geometry.bottom() + 1;
+            first = false;
+            break;
+        }
+    }
+
+    bool reachEnd = true;
+    int repaintTop = INT_MAX; // 绘制标题模式下需要重绘的起始位置
+    int changedTop = INT_MAX, changedBottom = INT_MIN; // 位置发生变化的范围，包括标题和handle
+    // from之前的页面顺序和位置没有变化，从from开始重新填写span
+    int span = int(std::lower_bound(spanIndex.constBegin(), spanIndex.constEnd(), from) - spanIndex.constBegin());
+    for(int i = from; i < count; i++)
+    {
+        auto item = items.at(i);
+        if(item->isHidden())
+            continue;
+
+        int th = titleHeight(item);
+        offset += (first ? 0 : hw);
+        offset += th;
+
+        int h = item->layoutHeight;
+        QRect end(x, offset, width, h);
+
+        const bool changed = end != item->geometry || th != item->titleHeight;
+        if(!changed && i > dirtyLast)
+        {
+            // 之后的页面高度没有变化，位置也不会变化
+            reachEnd = false;
+            break;
+        }
+
+        if(span < spanIndex.count())
+        {
+            spanIndex[span] = i;
+            spanBottoms[span] = end.bottom();
+        }
+        else
+        {
+            spanIndex.append(i);
+            spanBottoms.append(end.bottom());
+        }
+        span++;
+
+        if(changed)
+        {
+            const int top = qMin(item->geometry.top(), end.top()) - qMax(th, item->titleHeight) - hw - 2;
+            changedTop = qMin(changedTop, top);
+            changedBottom = qMax(changedBottom, qMax(item->geometry.bottom(), end.bottom()));
+            if(paintedTitles)
+                repaintTop = qMin(repaintTop, top);
+        }
+
+        // 将要进入可见区域的页面先准备好容器，保证展开动画能看到内容
+        if(virtualEnable && !item->tabContainer && area.intersects(end))
+            ensureContainer(item);
+        QRect start = item->tabContainer ? item->tabContainer->geometry() : end;
+
+        bool freezeSize = item->freezeTarget;
+        if(freezeSize && item->expanded() && item->widget)
+        {
+            item->widget->resize(end.size());
+        }
+
+        if(animate && start != end)
+        {
+            // 截图模式：widget只在动画开始时调整一次尺寸，动画过程中只移动和裁剪截图
+            bool snapshot = false;
+            if(snapshotAnimation && item->tabContainer && item->widget && item->tabContainer->isVisible())
+            {
+                if(!freezeSize && end.height() > start.height())
+                    item->widget->setGeometry(QRect(QPoint(0, 0), end.size()));
+                item->tabContainer->setSnapshot(item->widget, start.size().expandedTo(end.size()));
+                snapshot = true;
+            }
+            animatedPages.append({item, start, end, th, freezeSize, snapshot});
+        }
+        else if(changed)
+        {
+            applyGeometry(item, end, th, freezeSize);
+        }
+        item->geometry = end;
+        item->titleHeight = th;
+        item->freezeTarget = false;
+        offset += h;
+        first = false;
+    }
+    if(reachEnd)
+    {
+        contentBottom = offset - 1;
+        spanIndex.resize(span);
+        spanBottoms.resize(span);
+    }
+    if(repaintTop != INT_MAX)
+        q->update(QRect(cr.left(), repaintTop, cr.width(), cr.bottom() - repaintTop + 1));
+    boxSpacing = cr.bottom() - contentBottom;
+    dirtyFirst = INT_MAX;
+    dirtyLast = -1;
+    if(!animatedPages.isEmpty())
+    {
+        if(!timeline)
+        {
+            timeline = new QVariantAnimation(this);
+            timeline->setDuration(100);
+            timeline->setStartValue(0.0);
+            timeline->setEndValue(1.0);
+            connect(timeline, &QVariantAnimation::valueChanged, this, &AdvancedToolBoxPrivate::animationFrame);
+            connect(timeline, &QVariantAnimation::finished, this, &AdvancedToolBoxPrivate::animationFinished);
+        }
+        isAnimationState = true;
+        timeline->start();
+    }
+    else if(moveOnly)
+    {
+        // 拖动handle不改变sizeHint、显示状态和延迟页面，虚拟化只检查位置变化的范围
+        updateScrollRange();
+        if(changedTop <= changedBottom)
+            updateVirtualPages(changedTop, changedBottom);
+        updateStickyTitle();
+    }
+    else
+    {
+        resetSizeHint();
+        updateScrollRange();
+        updateVirtualPages();
+        updateStickyTitle();
+        suspendQueuedPages();
+        scheduleLazyPages();
+    }
+    nextIsAnimation = false;
+}
+
+// y所在的可见页面在span中的位置，y在所有页面下方时返回-1
+int AdvancedToolBoxPrivate::spanAt(int y) const
+{
+    auto it = std::lower_bound(spanBottoms.constBegin(), spanBottoms.constEnd(), y);
+    if(it == spanBottoms.constEnd())
+        return -1;
+    return int(it - spanBottoms.constBegin());
+}
+
+// y所在的页面序号，y在第一个页面上方时返回第一个页面
+int AdvancedToolBoxPrivate::pageAt(int y) const
+{
+    const int span = spanAt(y);
+    if(span < 0)
+        return -1;
+    const int index = spanIndex.at(span);
+    return index < items.count() ? index : -1;
+}
+
+// 设置页面容器、标题以及上方handle的位置，rect为容器的位置
+void AdvancedToolBoxPrivate::applyGeometry(ToolBoxItem *item, const QRect &rect, int titleHeight, bool freezeSize)
+{
+    Q_Q(AdvancedToolBox);
+    TOOLBOX_STATS_ADD(this, geometrySetCount);
+    const int hw = handleWidth;
+    if(item->tabContainer)
+        item->tabContainer->setGeometry(rect);
+    if(!freezeSize && item->widget)
+    {
+        item->widget->setGeometry(QRect(QPoint(0, 0), rect.size()));
+    }
+    if(!item->tabTitle)
+        return;
+    QRect r(rect.left(), rect.top() - titleHeight, rect.width(), titleHeight);
+    item->tabTitle->setGeometry(r);
+
+    if(item->handle->isVisibleTo(q))
+    {
+        r = QRect(r.left(), r.top() - hw, r.width(), hw);
+        if(hw <= 1)
+            r.adjust(0, -2, 0, 2);
+        item->handle->setGeometry(r);
+    }
+}
+
+// 动画的每一帧一次性插值所有页面的位置，只重绘页面移动前后覆盖的区域（分割线和绘制的标题由AdvancedToolBox绘制）
+void AdvancedToolBoxPrivate::animationFrame(const QVariant &value)
+{
+    Q_Q(AdvancedToolBox);
+    if(animatedPages.isEmpty())
+        return;
+
+    TOOLBOX_STATS_ADD(this, animationFrameCount);
+    const qreal t = value.toReal();
+    auto lerp = [t](int from, int to) -> int {
+        return from + qRound((to - from) * t);
+    };
+    // 页面区域向上包含标题和handle
+    auto pageArea = [this](const QRect &rect, int titleHeight) -> QRect {
+        return rect.adjusted(0, -titleHeight - handleWidth - 2, 0, 0);
+    };
+    QRect dirty;
+    for(const AnimatedPage &page : animatedPages)
+    {
+        QRect rect(lerp(page.start.left(), page.end.left()),
+                   lerp(page.start.top(), page.end.top()),
+                   lerp(page.start.width(), page.end.width()),
+                   lerp(page.start.height(), page.end.height()));
+        if(rect == page.item->geometry)
+            continue;
+        dirty |= pageArea(page.item->geometry, page.titleHeight);
+        dirty |= pageArea(rect, page.titleHeight);
+        applyGeometry(page.item, rect, page.titleHeight, page.freezeSize || page.snapshot);
+        // 动画过程中分割线、绘制的标题以及点击位置都跟随当前位置，最后一帧回到目标位置
+        page.item->geometry = rect;
+    }
+    if(!dirty.isEmpty())
+        q->update(dirty);
+}
+
+void AdvancedToolBoxPrivate::animationFinished()
+{
+    // 保证最后一帧停在目标位置
+    animationFrame(1.0);
+    // 移除截图，换回真实的widget
+    for(const AnimatedPage &page : animatedPages)
+    {
+        if(!page.snapshot)
+            continue;
+        if(page.item->tabContainer)
+            page.item->tabContainer->clearSnapshot();
+        applyGeometry(page.item, page.end, page.titleHeight, page.freezeSize);
+    }
+    animatedPages.clear();
+    isAnimationState = false;
+    updateGeometries(nextIsAnimation);
+    resetSizeHint();
+}
+
+// 更新handle顺序以及重新设置隐藏和显示
+// 只处理pagesDirtyFrom之后的页面，之前的页面顺序和显示状态没有变化
+void AdvancedToolBoxPrivate::resetPages()
+{
+    if(updateDepth > 0)
+        return;
+
+    const int count = items.count();
+    const int from = qMin(pagesDirtyFrom, count);
+    pagesDirtyFrom = INT_MAX;
+
+    bool visible = false;
+    for(int i = from - 1; i >= 0; i--)
+    {
+        if(!items.at(i)->isHidden())
+        {
+            visible = true;
+            break;
+        }
+    }
+    for(int i = from; i < count; i++)
+    {
+        auto item = items.at(i);
+        item->index = i;
+        if(item->tabTitle)
+            item->tabTitle->setIndex(i);
+        if(item->handle)
+            item->handle->setIndex(i);
+        // 页面顺序或显示状态变化后，位置需要重新设置
+        item->titleHeight = -1;
+        if(item->isHidden())
+        {
+            if(item->tabTitle)
+                item->tabTitle->hide();
+            if(item->tabContainer)
+                item->tabContainer->hide();
+            if(item->handle)
+                item->handle->setVisible(false);
+        }
+        else
+        {
+            if(item->tabTitle)
+                item->tabTitle->show();
+            if(item->tabContainer)
+                item->tabContainer->show();
+            if(item->handle)
+                item->handle->setVisible(visible); // 将第一个handle隐藏
+            visible = true;
+        }
+    }
+    markDirty(from, count - 1);
+}
+
+ToolBoxSplitterHandle *AdvancedToolBoxPrivate::createHandle()
+{
+    Q_Q(AdvancedToolBox);
+    ToolBoxSplitterHandle *handle = new ToolBoxSplitterHandle(q);
+    handle->setAttribute(Qt::WA_MouseNoMask, true);
+    handle->setAutoFillBackground(false);
+    handle->setVisible(false);
+    handle->setCursor(Qt::SizeVerCursor);
+    // handle->installEventFilter(this);
+    return handle;
+}
+
+ToolBoxTitle *AdvancedToolBoxPrivate::createTitle(const QString &label, const QIcon &icon)
+{
+    Q_Q(AdvancedToolBox);
+    ToolBoxTitle *title = new ToolBoxTitle(label, icon, q);
+
+    QObject::connect(title, &ToolBoxTitle::titleClicked, this, [this](int index)
+                     {
+                         auto item = items.value(index);
+                         if(item)
+                             setIndexExpand(index, !item->isExpanded); });
+
+    QObject::connect(title, &ToolBoxTitle::titleContextMenuRequest, this, &AdvancedToolBoxPrivate::showTitleMenu);
+    return title;
+}
+
+// 标题高度只与样式、字体以及是否有图标有关，所有页面共用，样式或字体变化后重新计算
+int AdvancedToolBoxPrivate::titleHeight(bool hasIcon)
+{
+    int &height = titleHeights[hasIcon ? 1 : 0];
+    if(height >= 0)
+        return height;
+
+    Q_Q(AdvancedToolBox);
+    // 标题子窗口可能被style sheet单独设置了字体等，使用其中一个标题计算
+    const QWidget *source = q;
+    if(!paintedTitles)
+    {
+        for(auto item : items)
+        {
+            if(item->tabTitle)
+            {
+                source = item->tabTitle;
+                break;
+            }
+        }
+    }
+    source->ensurePolished();
+    QStyleOptionTab opt;
+    opt.initFrom(source);
+    opt.state &= ~QStyle::State_MouseOver;
+    opt.state |= QStyle::State_On;
+    QSize icon_size = hasIcon ? titleIconSize : QSize(0, 0);
+    height = toolBoxTitleSize(opt, icon_size, source->style(), q).height();
+    return height;
+}
+
+// 字体、样式或标题模式变化后重新计算标题尺寸，所有标题只在这里失效一次
+void AdvancedToolBoxPrivate::titleMetricsChanged()
+{
+    resetTitleMetrics();
+    for(auto item : items)
+    {
+        if(item->tabTitle)
+            item->tabTitle->resetSizeHint();
+    }
+    if(stickyTitle)
+        stickyTitle->resetSizeHint();
+    markDirty(0, items.count() - 1);
+    resetSizeHint();
+    doLayout();
+}
+
+void AdvancedToolBoxPrivate::updateTitle(ToolBoxItem *item)
+{
+    if(item == stickyItem)
+        updateStickyTitle();
+    if(item->tabTitle)
+    {
+        item->tabTitle->update();
+    }
+    else if(!item->isHidden())
+    {
+        Q_Q(AdvancedToolBox);
+        q->update(item->titleRect());
+    }
+}
+
+QPixmap AdvancedToolBoxPrivate::grabTitle(ToolBoxItem *item)
+{
+    if(item->tabTitle)
+        return item->tabTitle->grab();
+    Q_Q(AdvancedToolBox);
+    return q->grab(item->titleRect());
+}
+
+// 切换绘制标题模式，标题和handle子窗口在两种模式之间重建或销毁
+void AdvancedToolBoxPrivate::setPaintedTitles(bool enable)
+{
+    if(paintedTitles == enable)
+        return;
+
+    Q_Q(AdvancedToolBox);
+    paintedTitles = enable;
+    hoverItem = nullptr;
+    hoverBranch = false;
+    pressItem = nullptr;
+    pressPart = HitNone;
+    titleDown = false;
+    if(handleCursor)
+    {
+        handleCursor = false;
+        q->unsetCursor();
+    }
+
+    auto watch = [this, enable](ToolBoxPageContainer *container) {
+        if(enable)
+            container->installEventFilter(this);
+        else
+            container->removeEventFilter(this);
+    };
+    for(auto item : items)
+    {
+        if(enable)
+        {
+            item->tabTitle->hide();
+            item->tabTitle->deleteLater();
+            item->tabTitle = nullptr;
+            item->handle->hide();
+            item->handle->deleteLater();
+            item->handle = nullptr;
+        }
+        else
+        {
+            item->tabTitle = createTitle(item->text, item->icon);
+            item->tabTitle->setExpanded(item->isExpanded);
+            item->handle = createHandle();
+        }
+        if(item->tabContainer)
+            watch(item->tabContainer);
+    }
+    for(auto container : containerPool)
+        watch(container);
+
+    q->setMouseTracking(enable);
+    markPagesDirty(0);
+    // 两种模式分别使用标题子窗口和AdvancedToolBox计算标题高度，字体或样式可能不同
+    titleMetricsChanged();
+    q->update();
+}
+
+void AdvancedToolBoxPrivate::paintTitle(QPainter *painter, ToolBoxItem *item)
+{
+    Q_Q(AdvancedToolBox);
+    TOOLBOX_STATS_ADD(this, titlePaintCount);
+    QStyleOptionToolBox opt;
+    opt.initFrom(q);
+    opt.state &= ~(QStyle::State_MouseOver | QStyle::State_HasFocus);
+    opt.rect = item->titleRect();
+    opt.text = item->text;
+    opt.icon = item->icon;
+    if(item == hoverItem)
+        opt.state |= QStyle::State_MouseOver;
+    if(item == pressItem && titleDown)
+        opt.state |= QStyle::State_Sunken;
+    if(item->isExpanded)
+        opt.state |= QStyle::State_Open;
+    const QSize icon_size = item->icon.isNull() ? QSize(0, 0) : titleIconSize;
+    const bool branch = item == hoverItem && hoverBranch;
+    if(titleCacheEnable)
+        drawCachedToolBoxTitle(opt, branch, indent, icon_size, titleStyleSerial, q->style(), painter, q);
+    else
+        drawToolBoxTitle(opt, branch, indent, icon_size, q->style(), painter, q);
+}
+
+// 按照布局结果查找pos处的标题或handle
+AdToolBoxItem *AdvancedToolBoxPrivate::hitTest(const QPoint &pos, HitPart *part) const
+{
+    *part = HitNone;
+    const int span = spanAt(pos.y());
+    if(span < 0)
+        return nullptr;
+
+    // handle较窄时会向上扩展到前一个页面的区域，所以同时检查下一个页面的handle
+    for(int s = span; s <= span + 1 && s < spanIndex.count(); s++)
+    {
+        ToolBoxItem *item = items.value(spanIndex.at(s));
+        if(!item || item->isHidden())
+            break;
+        if(s > 0 && item->handleRect(handleWidth).contains(pos))
+        {
+            *part = HitHandle;
+            return item;
+        }
+        if(item->titleRect().contains(pos))
+        {
+            *part = HitTitle;
+            return item;
+        }
+    }
+    return nullptr;
+}
+
+void AdvancedToolBoxPrivate::setHover(const QPoint &pos)
+{
+    Q_Q(AdvancedToolBox);
+    HitPart part = HitNone;
+    ToolBoxItem *item = hitTest(pos, &part);
+
+    const bool cursor = part == HitHandle;
+    if(cursor != handleCursor)
+    {
+        handleCursor = cursor;
+        if(cursor)
+            q->setCursor(Qt::SizeVerCursor);
+        else
+            q->unsetCursor();
+    }
+
+    ToolBoxItem *hover = part == HitTitle ? item : nullptr;
+    const bool branch = hover && pos.x() <= hover->titleRect().left() + indent;
+    if(hover == hoverItem && branch == hoverBranch)
+        return;
+    if(hoverItem)
+        updateTitle(hoverItem);
+    hoverItem = hover;
+    hoverBranch = branch;
+    if(hoverItem)
+        updateTitle(hoverItem);
+}
+
+bool AdvancedToolBoxPrivate::titleMousePress(QMouseEvent *event)
+{
+    if(event->buttons() != Qt::LeftButton)
+        return false;
+
+    HitPart part = HitNone;
+    ToolBoxItem *item = hitTest(event->pos(), &part);
+    if(!item)
+        return false;
+
+    pressItem = item;
+    pressPart = part;
+    pressPos = event->globalPos();
+    if(part == HitHandle)
+    {
+        handlePressed(itemIndex(item));
+    }
+    else
+    {
+        titleDown = true;
+        updateTitle(item);
+    }
+    return true;
+}
+
+bool AdvancedToolBoxPrivate::titleMouseMove(QMouseEvent *event)
+{
+    if(!pressItem)
+    {
+        setHover(event->pos());
+        return false;
+    }
+
+    if(pressPart == HitHandle)
+    {
+        handleMoved(itemIndex(pressItem), event->globalPos().y() - pressPos.y());
+        return true;
+    }
+
+    ToolBoxItem *item = pressItem;
+    if((event->globalPos() - pressPos).manhattanLength() > QApplication::startDragDistance())
+    {
+        Q_Q(AdvancedToolBox);
+        pressItem = nullptr;
+        pressPart = HitNone;
+        titleDown = false;
+        updateTitle(item);
+        q->startDrag(itemIndex(item), pressPos);
+        return true;
+    }
+
+    const bool down = item->titleRect().contains(event->pos());
+    if(down != titleDown)
+    {
+        titleDown = down;
+        updateTitle(item);
+    }
+    return true;
+}
+
+bool AdvancedToolBoxPrivate::titleMouseRelease(QMouseEvent *event)
+{
+    if(event->button() != Qt::LeftButton || !pressItem)
+        return false;
+
+    ToolBoxItem *item = pressItem;
+    const HitPart part = pressPart;
+    pressItem = nullptr;
+    pressPart = HitNone;
+    if(part == HitHandle)
+    {
+        handleReleased();
+        return true;
+    }
+
+    const bool click = titleDown && item->titleRect().contains(event->pos());
+    titleDown = false;
+    updateTitle(item);
+    if(click)
+        setIndexExpand(itemIndex(item), !item->isExpanded);
+    return true;
+}
+
+bool AdvancedToolBoxPrivate::titleContextMenu(QContextMenuEvent *event)
+{
+    HitPart part = HitNone;
+    ToolBoxItem *item = hitTest(event->pos(), &part);
+    if(!item || part != HitTitle)
+        return false;
+
+    showTitleMenu(itemIndex(item), event->globalPos());
+    return true;
+}
+
+// 页面较多时，菜单中使用可过滤的列表代替每个页面一个action
+static const int TitleMenuListThreshold = 30;
+
+// 标题菜单中页面列表使用的model，直接读取页面数据
+class ToolBoxPageListModel : public QAbstractListModel
+{
+  public:
+    explicit ToolBoxPageListModel(AdvancedToolBoxPrivate *d)
+        : QAbstractListModel(d)
+        , d(d)
+    {
+    }
+
+    // 行数只在reset中更新，页面变化和reset之间视图看到的行数保持一致
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override
+    {
+        return parent.isValid() ? 0 : rows;
+    }
+
+    QVariant data(const QModelIndex &index, int role) const override
+    {
+        auto item = d->items.value(index.row());
+        if(!item)
+            return QVariant();
+        if(role == Qt::DisplayRole)
+            return item->title();
+        if(role == Qt::CheckStateRole)
+            return item->isHidden() ? Qt::Unchecked : Qt::Checked;
+        return QVariant();
+    }
+
+    Qt::ItemFlags flags(const QModelIndex &index) const override
+    {
+        auto item = d->items.value(index.row());
+        if(!item)
+            return Qt::NoItemFlags;
+        Qt::ItemFlags flags = Qt::ItemIsEnabled | Qt::ItemIsSelectable;
+        // 最后一个显示的页面不能隐藏
+        if(item->isHidden() || d->menuVisibleCount > 1)
+            flags |= Qt::ItemIsUserCheckable;
+        return flags;
+    }
+
+    bool setData(const QModelIndex &index, const QVariant &value, int role) override
+    {
+        if(role != Qt::CheckStateRole || !d->items.value(index.row()))
+            return false;
+        const bool visible = value.toInt() == Qt::Checked;
+        if(visible == d->items.at(index.row())->isHidden())
+        {
+            d->setIndexVisible(index.row(), visible);
+            d->menuVisibleCount += visible ? 1 : -1;
+            d->hideAction->setEnabled(d->menuVisibleCount > 1);
+            refresh();
+        }
+        return true;
+    }
+
+    void reset()
+    {
+        beginResetModel();
+        rows = d->items.count();
+        endResetModel();
+    }
+
+    void refresh()
+    {
+        if(rowCount() > 0)
+            emit dataChanged(index(0), index(rowCount() - 1));
+    }
+
+  private:
+    AdvancedToolBoxPrivate *d;
+    int rows = 0;
+};
+
+// 菜单只创建一次，页面变化后在下一次显示时同步
+void AdvancedToolBoxPrivate::ensureTitleMenu()
+{
+    if(titleMenu)
+        return;
+
+    Q_Q(AdvancedToolBox);
+    titleMenu = new QMenu(q);
+    hideAction = titleMenu->addAction(tr("Hide"));
+    connect(hideAction, &QAction::triggered, this, [this]() {
+        int index = menuItem ? itemIndex(menuItem) : -1;
+        if(index >= 0)
+            setIndexVisible(index, false);
+    });
+    titleMenu->addSeparator();
+    menuSeparator = titleMenu->addSeparator();
+    menuSeparator->setVisible(false);
+    connect(titleMenu, &QMenu::triggered, this, [this](QAction *action) {
+        int index = pageActions.indexOf(action);
+        if(index >= 0)
+            setIndexVisible(index, action->isChecked());
+    });
+}
+
+void AdvancedToolBoxPrivate::ensurePageList()
+{
+    if(pageListAction)
+        return;
+
+    QWidget *widget = new QWidget(titleMenu);
+    QVBoxLayout *layout = new QVBoxLayout(widget);
+    layout->setContentsMargins(4, 2, 4, 2);
+    QLineEdit *filter = new QLineEdit(widget);
+    filter->setPlaceholderText(tr("Filter"));
+    filter->setClearButtonEnabled(true);
+    QListView *view = new QListView(widget);
+    view->setUniformItemSizes(true);
+    view->setMaximumHeight(360);
+    layout->addWidget(filter);
+    layout->addWidget(view);
+
+    pageModel = new ToolBoxPageListModel(this);
+    QSortFilterProxyModel *proxy = new QSortFilterProxyModel(widget);
+    proxy->setFilterCaseSensitivity(Qt::CaseInsensitive);
+    proxy->setSourceModel(pageModel);
+    view->setModel(proxy);
+    connect(filter, &QLineEdit::textChanged, proxy, &QSortFilterProxyModel::setFilterFixedString);
+
+    pageListAction = new QWidgetAction(titleMenu);
+    pageListAction->setDefaultWidget(widget);
+    titleMenu->insertAction(menuSeparator, pageListAction);
+}
+
+// 同步菜单中的页面，页面较少时复用action，较多时使用列表
+void AdvancedToolBoxPrivate::syncTitleMenu()
+{
+    hideAction->setVisible(menuItem != nullptr);
+    menuVisibleCount = 0;
+    for(auto item : items)
+    {
+        if(!item->isHidden())
+            menuVisibleCount++;
+    }
+    hideAction->setEnabled(menuVisibleCount > 1);
+
+    const int count = items.count();
+    const bool list = count > TitleMenuListThreshold;
+    if(list)
+    {
+        qDeleteAll(pageActions);
+        pageActions.clear();
+        ensurePageList();
+        pageListAction->setVisible(true);
+        if(menuDirty || pageModel->rowCount() != count)
+            pageModel->reset();
+        else
+            pageModel->refresh();
+    }
+    else
+    {
+        if(pageListAction)
+            pageListAction->setVisible(false);
+        while(pageActions.count() < count)
+        {
+            QAction *action = new QAction(titleMenu);
+            action->setCheckable(true);
+            titleMenu->insertAction(pageListAction ? pageListAction : menuSeparator, action);
+            pageActions.append(action);
+        }
+        while(pageActions.count() > count)
+            delete pageActions.takeLast();
+        for(int i = 0; i < count; i++)
+        {
+            auto item = items.at(i);
+            QAction *action = pageActions.at(i);
+            const bool hidden = item->isHidden();
+            if(menuDirty)
+                action->setText(item->title());
+            action->setChecked(!hidden);
+            action->setEnabled(hidden || menuVisibleCount > 1);
+        }
+    }
+    menuDirty = false;
+}
+
+// 页面增删、顺序、显示状态或文字变化，rebuild为true时菜单中的页面列表需要重建。
+// 菜单打开时在下一次事件循环中同步一次，列表model发出reset或dataChanged，action不再对应已经变化的页面
+void AdvancedToolBoxPrivate::titleMenuChanged(bool rebuild)
+{
+    if(rebuild)
+        menuDirty = true;
+    if(!titleMenu || menuSyncPending || !titleMenu->isVisible())
+        return;
+    menuSyncPending = true;
+    QTimer::singleShot(0, this, [this]() {
+        menuSyncPending = false;
+        if(titleMenu->isVisible())
+            syncTitleMenu();
+    });
+}
+
+void AdvancedToolBoxPrivate::showTitleMenu(int index, const QPoint &gpos)
+{
+    Q_Q(AdvancedToolBox);
+    ensureTitleMenu();
+    menuItem = items.value(index);
+    syncTitleMenu();
+    emit q->titleMenuAboutToShow(index);
+    titleMenu->exec(gpos);
+}
+
+void AdvancedToolBoxPrivate::setDragRubberVisible(bool visible, const QRect &rect)
+{
+    if(!dragRubber && visible)
+    {
+        Q_Q(AdvancedToolBox);
+        dragRubber = new QRubberBand(QRubberBand::Rectangle, q);
+    }
+    if(visible)
+    {
+        dragRubber->setGeometry(rect);
+        dragRubber->show();
+    }
+    else if(dragRubber)
+    {
+        dragRubber->hide();
+    }
+}
+
+void AdvancedToolBoxPrivate::updateTitleIndent()
+{
+    for(auto item : items)
+    {
+        updateTitle(item);
+    }
+}
+
+// 将当前当前布局尺寸保存
+// 手动调整分割线位置、折叠展开，都会触发该逻辑
+void AdvancedToolBoxPrivate::resetManualSize()
+{
+    dragFirst = INT_MAX;
+    dragLast = -1;
+    for(auto item : items)
+    {
+        if(item->canResize())
+        {
+            item->manualHeight = item->layoutHeight;
+        }
+    }
+}
+
+// 页面widget被销毁时移除页面，布局合并到下一次事件循环，避免批量销毁时重复布局
+void AdvancedToolBoxPrivate::widgetDestroyed(QObject *o)
+{
+    ToolBoxItem *item = widgetItems.take(o);
+    if(!item)
+        return;
+
+    // widget正在析构，不再访问
+    item->widget = nullptr;
+    // model页面与行一一对应，只丢掉widget，之后按需重新创建
+    if(modelPages && item->extra && item->extra->modelIndex.isValid())
+    {
+        // 不在析构过程中创建widget，留到下一次事件循环
+        item->extra->estimate = item->sizeHint;
+        item->resetCollapsedTime();
+        scheduleLazyPages();
+    }
+    else
+    {
+        removeItem(itemIndex(item));
+    }
+    requestLayout();
+}
+
+void AdvancedToolBoxPrivate::resetSizeHint()
+{
+    if(updateDepth > 0)
+    {
+        pendingSizeHint = true;
+        return;
+    }
+    TOOLBOX_STATS_SCOPE(this, sizeHint);
+    int handle_h = 0;
+    QSize min_size  = QSize(0, 0);
+    QSize size = QSize(0, 0);
+    for(auto item : items)
+    {
+        if(item->isHidden())
+            continue;
+        if(item->expanded())
+        {
+            min_size.rheight() += item->minSize.height();
+            min_size.rwidth() =  std::max(item->minSize.width(), min_size.width());
+
+            size.rheight() += item->sizeHint.height();
+            size.rwidth() =  std::max(item->sizeHint.width(), size.width());
+        }
+        {
+            int title = titleHeight(item);
+            min_size.rheight() += title;
+            size.rheight() += title;
+        }
+        handle_h += handleWidth;
+    }
+    min_size.rheight() += std::max(handle_h - handleWidth, 0);
+    size.rheight() += std::max(handle_h - handleWidth, 0);
+    if(minSizeHint != min_size || sizeHint != size)
+    {
+        minSizeHint = min_size;
+        sizeHint = size;
+        Q_Q(AdvancedToolBox);
+        q->updateGeometry();
+    }
+}
+
+void AdvancedToolBoxPrivate::calItemSize(ToolBoxItem *item)
+{
+    TOOLBOX_STATS_SCOPE(this, itemSize);
+    item->calItemSize();
+}
+
+// 在线程池中执行provider，结果通过watcher回到GUI线程。页面移除或重新设置时删除watcher，旧的结果不再返回
+void AdvancedToolBoxPrivate::setItemSizeProvider(ToolBoxItem *item, const AdvancedToolBox::SizeProvider &provider)
+{
+    if(item->extra)
+    {
+        delete item->extra->sizeWatcher;
+        item->extra->sizeWatcher = nullptr;
+    }
+    if(!provider)
+    {
+        if(item->extra && item->extra->providedSize.isValid())
+            itemSizeProvided(item, QSize());
+        return;
+    }
+
+    auto watcher = new QFutureWatcher<QSize>(this);
+    item->ensureExtra()->sizeWatcher = watcher;
+    connect(watcher, &QFutureWatcher<QSize>::finished, this, [this, item, watcher]() {
+        item->extra->sizeWatcher = nullptr;
+        watcher->deleteLater();
+        itemSizeProvided(item, watcher->result());
+    });
+    watcher->setFuture(QtConcurrent::run(provider));
+}
+
+void AdvancedToolBoxPrivate::populate(const AdvancedToolBox::PageGenerator &generator, int total, int frameBudget)
+{
+    if(populateGenerator)
+        finishPopulate(true);
+    if(!generator)
+        return;
+
+    populateSerial++;
+    populateGenerator = generator;
+    populateBudget = qMax(frameBudget, 1);
+    populateCount = 0;
+    populateTotal = total;
+    if(!populateTimer)
+    {
+        populateTimer = new QTimer(this);
+        populateTimer->setSingleShot(true);
+        populateTimer->setInterval(0);
+        connect(populateTimer, &QTimer::timeout, this, &AdvancedToolBoxPrivate::populateChunk);
+    }
+    populateTimer->start();
+}
+
+// 每一批在时间预算内尽量多地添加页面，批内的布局合并到endUpdate，之后回到事件循环处理绘制和输入
+void AdvancedToolBoxPrivate::populateChunk()
+{
+    Q_Q(AdvancedToolBox);
+    if(!populateGenerator)
+        return;
+
+    // 调用副本，生成器中取消或重新开始填充时不会析构正在执行的函数
+    const AdvancedToolBox::PageGenerator generator = populateGenerator;
+    const quint32 serial = populateSerial;
+    QElapsedTimer timer;
+    timer.start();
+    bool done = false;
+    beginUpdate();
+    do
+    {
+        AdvancedToolBox::PopulatePage page;
+        if(!generator(page))
+        {
+            done = true;
+            break;
+        }
+        bool added = true;
+        if(page.widget)
+            insertWidgetToList(items.count(), page.widget, page.label, page.icon);
+        else if(page.factory)
+            insertLazyToList(items.count(), page.factory, page.estimatedSize, page.label, page.icon);
+        else
+            added = false;
+        // 生成器中取消或重新开始了填充，已生成的页面仍然加入，避免widget泄漏
+        if(serial != populateSerial)
+            break;
+        if(added)
+            populateCount++;
+    } while(timer.elapsed() < populateBudget);
+    endUpdate();
+    if(serial != populateSerial)
+        return;
+
+    emit q->populateProgress(populateCount, populateTotal);
+    // 信号中可能取消或重新开始了填充
+    if(serial != populateSerial)
+        return;
+    if(done)
+        finishPopulate(false);
+    else
+        populateTimer->start();
+}
+
+void AdvancedToolBoxPrivate::finishPopulate(bool canceled)
+{
+    Q_Q(AdvancedToolBox);
+    populateSerial++;
+    populateGenerator = nullptr;
+    if(populateTimer)
+        populateTimer->stop();
+    emit q->populateFinished(canceled);
+}
+
+// 打开时将已有页面的文字和图标放入池中，关闭后新的页面不再使用池，已共用的数据保持不变
+void AdvancedToolBoxPrivate::setSharedResources(bool enable)
+{
+    if(sharedResources == enable)
+        return;
+
+    sharedResources = enable;
+    if(!enable)
+        return;
+    for(auto item : items)
+    {
+        item->text = shareText(item->text);
+        item->icon = shareIcon(item->icon);
+        if(item->tabTitle)
+        {
+            item->tabTitle->setText(item->text);
+            item->tabTitle->setIcon(item->icon);
+        }
+    }
+}
+
+// 同一次事件循环中返回的结果合并为一次布局
+void AdvancedToolBoxPrivate::itemSizeProvided(ToolBoxItem *item, const QSize &size)
+{
+    item->ensureExtra()->providedSize = size;
+    calItemSize(item);
+    requestLayout();
+}
+
+// 合并同一次事件循环中的统计变化，只发送一次statsUpdated
+void AdvancedToolBoxPrivate::statsChanged()
+{
+    if(statsPending)
+        return;
+    statsPending = true;
+    QTimer::singleShot(0, this, [this]() {
+        Q_Q(AdvancedToolBox);
+        statsPending = false;
+        if(statsEnable)
+            emit q->statsUpdated(stats);
+    });
+}
+
+void AdvancedToolBoxPrivate::beginUpdate()
+{
+    updateDepth++;
+}
+
+// 最外层endUpdate时，合并执行期间被延迟的操作
+void AdvancedToolBoxPrivate::endUpdate()
+{
+    if(updateDepth <= 0 || --updateDepth > 0)
+        return;
+
+    const bool sizeHint = pendingSizeHint;
+    const bool layout = pendingLayout;
+    const bool geometries = pendingGeometries;
+    pendingSizeHint = pendingLayout = pendingGeometries = false;
+
+    if(sizeHint)
+        resetSizeHint();
+    if(layout)
+    {
+        doLayout();
+    }
+    else if(geometries)
+    {
+        if(pagesDirtyFrom < items.count())
+            resetPages();
+        updateGeometries();
+    }
+}
+
+static const quint32 StateMagic = 0x41544258; // "ATBX"
+static const quint8 StateVersion = 1;
+
+enum StateFlag
+{
+    StateExpanded = 0x01,
+    StateHidden = 0x02
+};
+
+// 状态格式：magic、version、页面数量，之后按当前顺序保存每个页面的
+// 创建序号、展开/隐藏标记以及高度。页面本身不保存，恢复时按创建顺序对应
+QByteArray AdvancedToolBoxPrivate::saveState() const
+{
+    const int count = items.count();
+    QVector<int> order(count);
+    for(int i = 0; i < count; i++)
+        order[i] = i;
+    std::sort(order.begin(), order.end(), [this](int a, int b) {
+        return items.at(a)->id < items.at(b)->id;
+    });
+    QVector<quint32> rank(count);
+    for(int r = 0; r < count; r++)
+        rank[order.at(r)] = quint32(r);
+
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << StateMagic << StateVersion << quint32(count);
+    for(int i = 0; i < count; i++)
+    {
+        ToolBoxItem *item = items.at(i);
+        quint8 flags = 0;
+        flags |= item->isExpanded ? StateExpanded : 0;
+        flags |= item->hidden ? StateHidden : 0;
+        const int height = item->canResize() ? item->layoutHeight : item->manualHeight;
+        stream << rank.at(i) << flags << qint32(height);
+    }
+    return data;
+}
+
+// 一次性应用所有状态，只做一次布局，不使用动画。
+// 页面数量不一致时，能对应上的页面按保存的顺序排列，其余页面保持原顺序放在后面
+bool AdvancedToolBoxPrivate::restoreState(const QByteArray &state)
+{
+    QDataStream stream(state);
+    stream.setVersion(QDataStream::Qt_5_0);
+    quint32 magic = 0, count = 0;
+    quint8 version = 0;
+    stream >> magic >> version >> count;
+    if(stream.status() != QDataStream::Ok || magic != StateMagic || version != StateVersion)
+        return false;
+    // 每个页面占9个字节
+    if(count > quint32(state.size()) / 9)
+        return false;
+
+    struct Record
+    {
+        quint32 rank;
+        quint8 flags;
+        qint32 height;
+    };
+    QVector<Record> records(int(count));
+    for(Record &record : records)
+        stream >> record.rank >> record.flags >> record.height;
+    if(stream.status() != QDataStream::Ok)
+        return false;
+
+    QList<ToolBoxItem *> created = items;
+    std::sort(created.begin(), created.end(), [](ToolBoxItem *a, ToolBoxItem *b) {
+        return a->id < b->id;
+    });
+
+    beginUpdate();
+    QList<ToolBoxItem *> ordered;
+    ordered.reserve(items.count());
+    QVector<bool> used(created.count(), false);
+    // 状态变化的页面，布局完成后统一发送信号
+    QVector<QPair<ToolBoxItem *, int>> changed;
+    for(const Record &record : records)
+    {
+        if(record.rank >= quint32(created.count()) || used.at(int(record.rank)))
+            continue;
+        used[int(record.rank)] = true;
+        ToolBoxItem *item = created.at(int(record.rank));
+        ordered.append(item);
+
+        const bool expanded = record.flags & StateExpanded;
+        const bool expandChanged = item->isExpanded != expanded;
+        item->isExpanded = expanded;
+        if(item->tabTitle)
+            item->tabTitle->setExpanded(item->isExpanded);
+        const bool hidden = record.flags & StateHidden;
+        if(item->hidden != hidden)
+        {
+            item->hidden = hidden;
+            if(item->widget)
+                item->widget->setVisible(item->widgetVisible());
+            if(item->tabTitle)
+                item->tabTitle->setVisible(!hidden);
+            if(item->tabContainer)
+                item->tabContainer->setVisible(!hidden);
+        }
+        item->manualHeight = qMax(0, int(record.height));
+        const bool shownChanged = updatePageShown(item);
+        if(expandChanged || shownChanged)
+            changed.append(qMakePair(item, int(expandChanged) | int(shownChanged) << 1));
+        if(item->isExpanded && !item->hidden)
+        {
+            item->resetCollapsedTime();
+            materializePage(item);
+        }
+        else
+        {
+            pageCollapsed(item);
+        }
+    }
+    for(auto item : items)
+    {
+        auto it = std::lower_bound(created.constBegin(), created.constEnd(), item, [](ToolBoxItem *a, ToolBoxItem *b) {
+            return a->id < b->id;
+        });
+        if(!used.at(int(it - created.constBegin())))
+            ordered.append(item);
+    }
+    items = ordered;
+    markPagesDirty(0);
+    resetSizeHint();
+    doLayout();
+    endUpdate();
+
+    Q_Q(AdvancedToolBox);
+    q->update();
+    scheduleLazyPages();
+    // 先取得所有序号，信号中移除页面时不再访问已删除的页面
+    QVector<QPair<int, int>> notify;
+    notify.reserve(changed.count());
+    for(const auto &change : changed)
+        notify.append(qMakePair(itemIndex(change.first), change.second));
+    for(const auto &change : notify)
+        notifyPageState(change.first, change.second & 1, change.second & 2);
+    return true;
+}
+
+// 移除所有页面，deleteWidgets为true时销毁页面widget
+void AdvancedToolBoxPrivate::clearPages(bool deleteWidgets)
+{
+    beginUpdate();
+    for(int i = items.count() - 1; i >= 0; i--)
+    {
+        QWidget *widget = removeItem(i);
+        if(widget && deleteWidgets)
+            widget->deleteLater();
+    }
+    resetSizeHint();
+    doLayout();
+    endUpdate();
+}
+
+static QIcon modelIcon(const QVariant &value)
+{
+    if(value.canConvert<QIcon>())
+        return qvariant_cast<QIcon>(value);
+    if(value.canConvert<QPixmap>())
+        return QIcon(qvariant_cast<QPixmap>(value));
+    return QIcon();
+}
+
+void AdvancedToolBoxPrivate::setModel(QAbstractItemModel *m, const AdvancedToolBox::PageFactory &factory, const QModelIndex &root)
+{
+    if(model)
+        QObject::disconnect(model, nullptr, this, nullptr);
+
+    beginUpdate();
+    clearPages(modelPages);
+    model = m;
+    modelRoot = root;
+    pageFactory = factory;
+    modelPages = m != nullptr;
+    if(m)
+    {
+        connect(m, &QAbstractItemModel::rowsInserted, this, &AdvancedToolBoxPrivate::modelRowsInserted);
+        connect(m, &QAbstractItemModel::rowsRemoved, this, &AdvancedToolBoxPrivate::modelRowsRemoved);
+        connect(m, &QAbstractItemModel::rowsMoved, this, &AdvancedToolBoxPrivate::modelRowsMoved);
+        connect(m, &QAbstractItemModel::dataChanged, this, &AdvancedToolBoxPrivate::modelDataChanged);
+        connect(m, &QAbstractItemModel::modelReset, this, &AdvancedToolBoxPrivate::modelReset);
+        connect(m, &QAbstractItemModel::layoutChanged, this, &AdvancedToolBoxPrivate::modelLayoutChanged);
+        insertModelRows(0, m->rowCount(root) - 1);
+    }
+    endUpdate();
+}
+
+// 按行创建延迟页面，widget在页面第一次展开或可见时由pageFactory创建
+void AdvancedToolBoxPrivate::insertModelRows(int first, int last)
+{
+    if(first > last)
+        return;
+
+    beginUpdate();
+    for(int row = first; row <= last; row++)
+    {
+        const QModelIndex index = model->index(row, 0, modelRoot);
+        const QPersistentModelIndex page(index);
+        auto factory = [this, page]() -> QWidget * {
+            if(!page.isValid() || !pageFactory)
+                return nullptr;
+            return pageFactory(page);
+        };
+        insertLazyToList(row, factory, index.data(Qt::SizeHintRole).toSize(),
+                         index.data(Qt::DisplayRole).toString(), modelIcon(index.data(Qt::DecorationRole)));
+        if(auto item = items.value(row))
+            item->extra->modelIndex = page;
+    }
+    endUpdate();
+}
+
+void AdvancedToolBoxPrivate::modelRowsInserted(const QModelIndex &parent, int first, int last)
+{
+    if(parent == modelRoot)
+        insertModelRows(first, last);
+}
+
+void AdvancedToolBoxPrivate::modelRowsRemoved(const QModelIndex &parent, int first, int last)
+{
+    if(parent != modelRoot)
+        return;
+
+    beginUpdate();
+    for(int row = qMin(last, items.count() - 1); row >= first; row--)
+    {
+        if(QWidget *widget = removeItem(row))
+            widget->deleteLater();
+    }
+    resetSizeHint();
+    doLayout();
+    endUpdate();
+}
+
+void AdvancedToolBoxPrivate::modelRowsMoved(const QModelIndex &parent, int start, int end, const QModelIndex &destination, int row)
+{
+    const bool from = parent == modelRoot;
+    const bool to = destination == modelRoot;
+    if(from && to)
+    {
+        // 行号为移动前的行号，row在移动范围之后时需要减去移动的数量
+        const int count = end - start + 1;
+        const int target = row > end ? row - count : row;
+        if(target == start || start < 0 || end >= items.count())
+            return;
+        QList<ToolBoxItem *> moved = items.mid(start, count);
+        for(int i = 0; i < count; i++)
+            items.removeAt(start);
+        for(int i = 0; i < count; i++)
+            items.insert(target + i, moved.at(i));
+        markPagesDirty(qMin(start, target));
+        resetPages();
+        updateGeometries();
+    }
+    else if(from)
+    {
+        modelRowsRemoved(parent, start, end);
+    }
+    else if(to)
+    {
+        insertModelRows(row, row + end - start);
+    }
+}
+
+void AdvancedToolBoxPrivate::modelDataChanged(const QModelIndex &topLeft, const QModelIndex &bottomRight, const QVector<int> &roles)
+{
+    if(topLeft.parent() != modelRoot || topLeft.column() > 0)
+        return;
+
+    const bool title = roles.isEmpty() || roles.contains(Qt::DisplayRole) || roles.contains(Qt::DecorationRole);
+    const bool estimate = roles.isEmpty() || roles.contains(Qt::SizeHintRole);
+    bool layout = false;
+    const int last = qMin(bottomRight.row(), items.count() - 1);
+    for(int row = topLeft.row(); row <= last; row++)
+    {
+        ToolBoxItem *item = items.at(row);
+        const QModelIndex index = model->index(row, 0, modelRoot);
+        if(title)
+        {
+            QIcon icon = modelIcon(index.data(Qt::DecorationRole));
+            // 图标有无会改变标题高度
+            if(item->icon.isNull() != icon.isNull())
+            {
+                layout = true;
+                markDirty(row, row);
+            }
+            item->text = shareText(index.data(Qt::DisplayRole).toString());
+            titleMenuChanged(true);
+            item->icon = shareIcon(icon);
+            if(item->tabTitle)
+            {
+                item->tabTitle->setText(item->text);
+                item->tabTitle->setIcon(item->icon);
+            }
+            else
+            {
+                updateTitle(item);
+            }
+        }
+        if(estimate && !item->widget && item->extra)
+        {
+            item->extra->estimate = index.data(Qt::SizeHintRole).toSize();
+            calItemSize(item);
+            layout = true;
+        }
+    }
+    if(layout)
+    {
+        resetSizeHint();
+        doLayout();
+    }
 }
 
-void AdvancedToolBoxPrivate::moveHandle(int index, int distance)
+// 排序、过滤等只改变行顺序，按持久索引重新排列页面，保留已创建的widget和展开状态
+void AdvancedToolBoxPrivate::modelLayoutChanged(const QList<QPersistentModelIndex> &parents)
 {
-    if(distance == 0)
+    if(!parents.isEmpty() && !parents.contains(modelRoot))
         return;
 
-    // adjectHandle入口在鼠标移动事件，当鼠标按下时，resetManualSize将当前布局存储
-    QVector<ToolBoxItem *> shrink_part, expand_part;
-    for(int i = index; i < items.count(); i++)
-    {
-        auto item = items.at(i);
-        if(item->canResize())
-            expand_part.append(item);
-    }
-    for(int i = index - 1; i >= 0; i--)
+    beginUpdate();
+    for(int i = items.count() - 1; i >= 0; i--)
     {
-        auto item = items.at(i);
-        if(item->canResize())
-            shrink_part.append(item);
+        const ToolBoxItem::Extra *extra = items.at(i)->extra;
+        if(extra && extra->modelIndex.isValid() && extra->modelIndex.parent() == modelRoot)
+            continue;
+        if(QWidget *widget = removeItem(i))
+            widget->deleteLater();
     }
+    std::stable_sort(items.begin(), items.end(), [](ToolBoxItem *a, ToolBoxItem *b) {
+        return a->extra->modelIndex.row() < b->extra->modelIndex.row();
+    });
+    markPagesDirty(0);
+    resetSizeHint();
+    doLayout();
+    endUpdate();
+}
 
-    if(distance > 0) // 交换一下
-        std::swap(shrink_part, expand_part);
-
-    int expand = 0, shrink = 0;
-    for(ToolBoxItem *item : shrink_part)
-        shrink += item->manualHeight - item->minSize.height();
-
-    for(ToolBoxItem *item : expand_part)
-        expand += item->maxSize.height() - item->manualHeight;
+void AdvancedToolBoxPrivate::modelReset()
+{
+    beginUpdate();
+    clearPages(true);
+    if(model)
+        insertModelRows(0, model->rowCount(modelRoot) - 1);
+    endUpdate();
+}
 
-    int min_dis = qMin(qMin(shrink, expand), abs(distance));
-    if(min_dis == 0)
+void AdvancedToolBoxPrivate::setVirtualEnable(bool enable)
+{
+    if(virtualEnable == enable)
         return;
 
-    //调整
-    int space = min_dis;
-    for(int i = 0; i < shrink_part.count(); i++)
+    virtualEnable = enable;
+    watchViewport();
+    if(enable)
     {
-        ToolBoxItem *item = shrink_part.at(i);
-        int diff = qMin(item->manualHeight - item->minSize.height(), space);
-        item->layoutHeight = item->manualHeight - diff;
-        space -= diff;
+        boundItems.clear();
+        for(auto item : items)
+        {
+            if(item->tabContainer)
+                boundItems.append(item);
+        }
+        updateVirtualPages();
     }
-
-    space = min_dis;
-    for(int i = 0; i < expand_part.count(); i++)
+    else
     {
-        ToolBoxItem *item = expand_part.at(i);
-        int diff = qMin(item->maxSize.height() - item->manualHeight, space);
-        item->layoutHeight = item->manualHeight + diff;
-        space -= diff;
+        for(auto item : items)
+            ensureContainer(item);
+        boundItems.clear();
+        qDeleteAll(containerPool);
+        containerPool.clear();
     }
-    updateGeometries();
 }
 
-// 根据计算好的布局，设置窗口位置等
-void AdvancedToolBoxPrivate::updateGeometries(bool animate)
+// 滚动模式使用绘制标题和虚拟化，滚动时只需要移动持有容器的页面
+void AdvancedToolBoxPrivate::setScrollEnable(bool enable)
 {
+    if(scrollEnable == enable)
+        return;
+
     Q_Q(AdvancedToolBox);
-    animate = animate && q->isVisible();
-    QParallelAnimationGroup *group = nullptr;
-    if(isAnimationState)
+    if(!enable)
+        scrollBar->setValue(0);
+    scrollEnable = enable;
+    if(enable && !scrollBar)
     {
-        nextIsAnimation = animate;
-        return;
+        scrollBar = new QScrollBar(Qt::Vertical, q);
+        scrollBar->hide();
+        connect(scrollBar, &QScrollBar::valueChanged, this, &AdvancedToolBoxPrivate::scrollTo);
+        stickyTitle = createTitle(QString(), QIcon());
+        stickyTitle->hide();
     }
-    if(animate)
+    if(!enable)
     {
-        isAnimationState = true;
-        group = new QParallelAnimationGroup();
-        QObject::connect(group, &QParallelAnimationGroup::finished, this,
-                         [this](){
-                             isAnimationState = false;
-                             updateGeometries(nextIsAnimation);
-                         });
+        scrollBar->hide();
+        stickyTitle->hide();
+        stickyItem = nullptr;
     }
+    setPaintedTitles(paintedSetting || enable);
+    setVirtualEnable(virtualSetting || enable);
+    markDirty(0, items.count() - 1);
+    resetSizeHint();
+    q->updateGeometry();
+    doLayout();
+}
 
-    const int hw = handleWidth;
+// 页面布局的区域，滚动模式下去掉滚动条
+QRect AdvancedToolBoxPrivate::contentRect() const
+{
+    Q_Q(const AdvancedToolBox);
     QRect cr = q->rect();
-    int x = cr.left(), offset = cr.top(), width = cr.width();
-    bool first = true;
-    for(auto item : items)
-    {
-        if(item->isHidden())
-            continue;
+    if(scrollEnable && scrollBar->isVisibleTo(q))
+        cr.setRight(cr.right() - scrollBar->sizeHint().width());
+    return cr;
+}
 
-        int th = item->tabTitle->sizeHint().height();
-        offset += (first ? 0 : hw);
-        offset += th;
+void AdvancedToolBoxPrivate::placeScrollBar()
+{
+    Q_Q(AdvancedToolBox);
+    const QRect cr = q->rect();
+    const int w = scrollBar->sizeHint().width();
+    scrollBar->setGeometry(QRect(cr.right() - w + 1, cr.top(), w, cr.height()));
+    scrollBar->raise();
+}
 
-        int h = item->layoutHeight;
-        QRect start = item->tabContainer->geometry();
-        QRect end(x, offset, width, h);
+// 布局完成后根据内容高度更新滚动范围，范围缩小时valueChanged会平移页面
+void AdvancedToolBoxPrivate::updateScrollRange()
+{
+    if(!scrollEnable)
+        return;
 
-        bool freezeSize = item->freezeTarget;
-        auto resizeTo = [q, item, th, hw, freezeSize](const QVariant &val)
-        {
-            QRect rect = val.toRect();
-            item->tabContainer->setGeometry(rect);
-            if(!freezeSize)
-            {
-                item->widget->setGeometry(QRect(QPoint(0, 0), rect.size()));
-            }
-            rect = QRect(rect.left(), rect.top() - th, rect.width(), th);
-            item->tabTitle->setGeometry(rect);
+    const QRect cr = contentRect();
+    const int contentHeight = contentBottom + scrollValue - cr.top() + 1;
+    scrollBar->setPageStep(cr.height());
+    scrollBar->setSingleStep(titleHeight(false));
+    scrollBar->setRange(0, qMax(0, contentHeight - cr.height()));
+}
 
-            if(item->handle->isVisibleTo(q))
-            {
-                rect = QRect(rect.left(), rect.top() - hw, rect.width(), hw);
-                if(hw <= 1)
-                    rect.adjust(0, -2, 0, 2);
-                item->handle->setGeometry(rect);
-            }
-        };
-        if(freezeSize && item->expanded())
-        {
-            item->widget->resize(end.size());
-        }
+// 平移所有页面的位置和span，只有持有容器的页面需要移动子窗口
+void AdvancedToolBoxPrivate::scrollTo(int value)
+{
+    if(value == scrollValue)
+        return;
 
-        if(animate && start != end)
-        {
-            QVariantAnimation *animation = new QVariantAnimation(group);
-            animation->setDuration(100);
-            animation->setStartValue(start);
-            animation->setEndValue(end);
-            connect(animation, &QVariantAnimation::valueChanged, this, resizeTo);
-            group->addAnimation(animation);
-        }
-        else
-        {
-            resizeTo(end);
-        }
-        item->freezeTarget = false;
-        offset += h;
-        first = false;
-    }
-    boxSpacing = cr.bottom() - (offset - 1);
-    if(group)
+    Q_Q(AdvancedToolBox);
+    if(isAnimationState)
     {
-        connect(group, &QVariantAnimation::finished, this, &AdvancedToolBoxPrivate::resetSizeHint);
-        group->start(QAbstractAnimation::DeleteWhenStopped);
+        // 动画使用的起止位置基于旧的偏移，直接结束，结束时的布局可能已经调整了滚动范围
+        nextIsAnimation = false;
+        timeline->stop();
+        animationFinished();
+        value = scrollBar->value();
     }
-    else
+    const int delta = scrollValue - value;
+    if(delta == 0)
+        return;
+    scrollValue = value;
+    for(auto item : items)
+        item->geometry.translate(0, delta);
+    for(int &bottom : spanBottoms)
+        bottom += delta;
+    contentBottom += delta;
+    boxSpacing = contentRect().bottom() - contentBottom;
+    for(auto item : boundItems)
     {
-        resetSizeHint();
+        if(!item->isHidden())
+            applyGeometry(item, item->geometry, item->titleHeight, true);
     }
-    nextIsAnimation = false;
+    updateVirtualPages();
+    updateStickyTitle();
+    scheduleLazyPages();
+    q->update();
 }
 
-// 更新handle顺序以及重新设置隐藏和显示
-void AdvancedToolBoxPrivate::resetPages()
+// 当前页面的标题滚出顶部后固定显示，下一个页面的标题到达时向上推出
+void AdvancedToolBoxPrivate::updateStickyTitle()
 {
-    int count = items.count();
-    bool visible = false;
-    for(int i = 0; i < count; i++)
+    if(!scrollEnable)
+        return;
+
+    const QRect cr = contentRect();
+    ToolBoxItem *item = scrollValue > 0 ? items.value(pageAt(cr.top())) : nullptr;
+    if(!item || item->isHidden() || !item->expanded() || item->titleRect().top() >= cr.top() ||
+       item->geometry.bottom() < cr.top())
     {
-        auto item = items.at(i);
-        item->tabTitle->setIndex(i);
-        item->handle->setIndex(i);
-        if(item->isHidden())
-        {
-            item->tabTitle->hide();
-            item->tabContainer->hide();
-            item->handle->setVisible(false);
-        }
-        else
-        {
-            item->tabTitle->show();
-            item->tabContainer->show();
-            item->handle->setVisible(visible); // 将第一个handle隐藏
-            visible = true;
-        }
+        stickyItem = nullptr;
+        stickyTitle->hide();
+        return;
     }
+
+    const int th = item->titleHeight;
+    const int top = qMin(cr.top(), item->geometry.bottom() + 1 - th);
+    stickyItem = item;
+    stickyTitle->setIndex(itemIndex(item));
+    stickyTitle->setText(item->text);
+    if(stickyTitle->icon().cacheKey() != item->icon.cacheKey())
+        stickyTitle->setIcon(item->icon);
+    stickyTitle->setExpanded(item->isExpanded);
+    stickyTitle->setGeometry(QRect(cr.left(), top, cr.width(), th));
+    stickyTitle->show();
+    stickyTitle->raise();
 }
 
-ToolBoxSplitterHandle *AdvancedToolBoxPrivate::createHandle()
+// 虚拟化模式下监听父窗口（QScrollArea的viewport）尺寸变化
+void AdvancedToolBoxPrivate::watchViewport()
 {
     Q_Q(AdvancedToolBox);
-    ToolBoxSplitterHandle *handle = new ToolBoxSplitterHandle(q);
-    handle->setAttribute(Qt::WA_MouseNoMask, true);
-    handle->setAutoFillBackground(false);
-    handle->setVisible(false);
-    handle->setCursor(Qt::SizeVerCursor);
-    // handle->installEventFilter(this);
-    return handle;
+    QWidget *parent = virtualEnable ? q->parentWidget() : nullptr;
+    if(viewport == parent)
+        return;
+    if(viewport)
+        viewport->removeEventFilter(this);
+    viewport = parent;
+    if(viewport)
+        viewport->installEventFilter(this);
 }
 
-ToolBoxTitle *AdvancedToolBoxPrivate::createTitle(const QString &label, const QIcon &icon)
+// 父窗口可见的区域，上下各预留半屏，避免滚动时频繁创建容器
+QRect AdvancedToolBoxPrivate::viewportRect() const
 {
-    Q_Q(AdvancedToolBox);
-    ToolBoxTitle *title = new ToolBoxTitle(label, icon, q);
-
-    QObject::connect(title, &ToolBoxTitle::titleClicked, this, [this](int index)
-                     {
-                         auto item = items.value(index);
-                         if(item)
-                             setIndexExpand(index, !item->isExpanded); });
-
-    QObject::connect(title, &ToolBoxTitle::titleContextMenuRequest, this, &AdvancedToolBoxPrivate::showTitleMenu);
-    return title;
+    Q_Q(const AdvancedToolBox);
+    if(scrollEnable)
+    {
+        const QRect area = contentRect();
+        const int overscan = area.height() / 2;
+        return area.adjusted(0, -overscan, 0, overscan);
+    }
+    QRect area = q->rect();
+    QWidget *parent = q->parentWidget();
+    if(!parent)
+        return area;
+    area &= QRect(q->mapFromParent(QPoint(0, 0)), parent->size());
+    if(area.isEmpty())
+        return area;
+    const int overscan = parent->height() / 2;
+    return area.adjusted(0, -overscan, 0, overscan);
 }
 
-void AdvancedToolBoxPrivate::showTitleMenu(int index, const QPoint &gpos)
+// 只检查当前持有容器的页面以及可见区域内的页面，[top, bottom]为位置发生变化的范围，范围外的页面不用检查
+void AdvancedToolBoxPrivate::updateVirtualPages(int top, int bottom)
 {
-    Q_Q(AdvancedToolBox);
-    QMenu *menu = new QMenu(q);
-    menu->setAttribute(Qt::WA_DeleteOnClose);
-    QAction *hide_action = menu->addAction(tr("Hide"));
-    menu->addSeparator();
-    int visible_count = 0;
-    QAction *first_checked = nullptr;
-    for(int i = 0; i < items.count(); i++)
+    if(!virtualEnable || isAnimationState)
+        return;
+
+    const QRect area = viewportRect();
+    for(int i = boundItems.count() - 1; i >= 0; i--)
     {
-        auto item = items.at(i);
-        const bool hidden = item->isHidden();
-        QAction *action = menu->addAction(item->title());
-        action->setCheckable(true);
-        action->setChecked(!hidden);
-        if(!hidden)
-        {
-            visible_count++;
-            if(!first_checked)
-                first_checked = action;
-            if(index == i)
-                QObject::connect(hide_action, SIGNAL(triggered(bool)), action, SLOT(trigger()));
-        }
-        auto bind_slot = std::bind(&AdvancedToolBoxPrivate::setIndexVisible, this, i, std::placeholders::_1);
-        QObject::connect(action, &QAction::triggered, this, bind_slot);
+        ToolBoxItem *item = boundItems.at(i);
+        if(item->geometry.bottom() < top || item->geometry.top() > bottom)
+            continue;
+        if(item->isHidden() || !area.intersects(item->geometry))
+            releaseContainer(item);
     }
+    if(area.isEmpty())
+        return;
 
-    hide_action->setVisible(index >= 0);
-    hide_action->setEnabled(visible_count > 1);
-    if(visible_count == 1 && first_checked)
+    const int last = qMin(area.bottom(), bottom);
+    const int first = spanAt(qMax(area.top(), top));
+    for(int s = qMax(first, 0); first >= 0 && s < spanIndex.count(); s++)
     {
-        first_checked->setEnabled(false);
+        ToolBoxItem *item = items.value(spanIndex.at(s));
+        if(!item || item->geometry.top() > last)
+            break;
+        if(!item->isHidden() && area.intersects(item->geometry))
+            ensureContainer(item);
     }
-    menu->exec(gpos);
 }
 
-void AdvancedToolBoxPrivate::setDragRubberVisible(bool visible, const QRect &rect)
+ToolBoxPageContainer *AdvancedToolBoxPrivate::ensureContainer(ToolBoxItem *item)
 {
-    if(!dragRubber && visible)
+    if(item->tabContainer)
+        return item->tabContainer;
+
+    Q_Q(AdvancedToolBox);
+    ToolBoxPageContainer *container = containerPool.isEmpty() ? new ToolBoxPageContainer(q) : containerPool.takeLast();
+    if(paintedTitles)
+        container->installEventFilter(this);
+    container->sizeDirty = false;
+    container->setGeometry(item->geometry);
+    if(QWidget *widget = item->widget)
     {
-        Q_Q(AdvancedToolBox);
-        dragRubber = new QRubberBand(QRubberBand::Rectangle, q);
+        widget->setParent(container);
+        widget->setGeometry(QRect(QPoint(0, 0), item->geometry.size()));
+        widget->setVisible(item->widgetVisible());
     }
-    if(visible)
+    container->setVisible(!item->hidden);
+    item->tabContainer = container;
+    if(virtualEnable)
+        boundItems.append(item);
+
+    // 离开可见区域期间尺寸可能发生了变化
+    if(item->widget)
     {
-        dragRubber->setGeometry(rect);
-        dragRubber->show();
+        QSize old = item->sizeHint, oldMin = item->minSize, oldMax = item->maxSize;
+        calItemSize(item);
+        if(old != item->sizeHint || oldMin != item->minSize || oldMax != item->maxSize)
+            requestLayout();
     }
-    else if(dragRubber)
+    return container;
+}
+
+QWidget *AdvancedToolBoxPrivate::ensureParkingLot()
+{
+    if(!parkingLot)
     {
-        dragRubber->hide();
+        Q_Q(AdvancedToolBox);
+        parkingLot = new QWidget(q);
+        parkingLot->hide();
     }
+    return parkingLot;
 }
 
-void AdvancedToolBoxPrivate::updateTitleIndent()
+void AdvancedToolBoxPrivate::releaseContainer(ToolBoxItem *item)
 {
-    for(auto item : items)
+    ToolBoxPageContainer *container = item->tabContainer;
+    if(!container)
+        return;
+
+    if(QWidget *widget = item->widget)
     {
-        item->tabTitle->update();
+        widget->setParent(ensureParkingLot());
+        widget->setVisible(item->widgetVisible());
     }
+    item->tabContainer = nullptr;
+    boundItems.removeOne(item);
+    container->clearSnapshot();
+    container->hide();
+    if(containerPool.count() < 16)
+        containerPool.append(container);
+    else
+        container->deleteLater();
 }
 
-// 将当前当前布局尺寸保存
-// 手动调整分割线位置、折叠展开，都会触发该逻辑
-void AdvancedToolBoxPrivate::resetManualSize()
+// 创建延迟页面的widget，返回尺寸是否发生变化
+bool AdvancedToolBoxPrivate::materializePage(ToolBoxItem *item)
 {
-    for(auto item : items)
+    if(item->widget || !item->isLazy())
+        return false;
+
+    QWidget *widget = item->extra->factory();
+    if(!widget)
+        return false;
+
+    widget->setParent(item->tabContainer ? item->tabContainer : ensureParkingLot());
+    widget->setGeometry(QRect(QPoint(0, 0), item->geometry.size()));
+    widget->setVisible(item->widgetVisible());
+    if(item->suspended)
+        widget->setUpdatesEnabled(false);
+    item->widget = widget;
+    widgetItems.insert(widget, item);
+    connect(widget, &QWidget::destroyed, this, &AdvancedToolBoxPrivate::widgetDestroyed);
+
+    QSize old = item->sizeHint, oldMin = item->minSize, oldMax = item->maxSize;
+    calItemSize(item);
+    return old != item->sizeHint || oldMin != item->minSize || oldMax != item->maxSize;
+}
+
+// 布局完成后，在下一次事件循环中创建可见的延迟页面，避免在布局过程中创建widget
+void AdvancedToolBoxPrivate::scheduleLazyPages()
+{
+    if(lazyCount <= 0)
+        return;
+    if(!lazyTimer)
     {
-        if(item->canResize())
-        {
-            item->manualHeight = item->layoutHeight;
-        }
+        lazyTimer = new QTimer(this);
+        lazyTimer->setSingleShot(true);
+        lazyTimer->setInterval(0);
+        connect(lazyTimer, &QTimer::timeout, this, &AdvancedToolBoxPrivate::materializeLazyPages);
     }
+    lazyTimer->start();
 }
 
-void AdvancedToolBoxPrivate::widgetDestroyed(QObject *o)
+void AdvancedToolBoxPrivate::materializeLazyPages()
 {
-    for(int i = 0; i < items.size(); i++)
+    Q_Q(AdvancedToolBox);
+    if(lazyCount <= 0 || !q->isVisible())
+        return;
+
+    bool changed = false;
+    const auto list = items;
+    for(auto item : list)
     {
-        if(items.at(i)->widget == o)
-        {
-            takeIndex(i);
-            break;
-        }
+        if(item->widget || !item->isLazy() || item->hidden || !item->isExpanded)
+            continue;
+        // 虚拟化模式下只创建可见区域内的页面
+        if(virtualEnable && !item->tabContainer)
+            continue;
+        if(materializePage(item))
+            changed = true;
+    }
+    if(changed)
+    {
+        resetSizeHint();
+        doLayout();
     }
 }
 
-void AdvancedToolBoxPrivate::resetSizeHint()
+void AdvancedToolBoxPrivate::pageCollapsed(ToolBoxItem *item)
 {
-    int handle_h = 0;
-    QSize min_size  = QSize(0, 0);
-    QSize size = QSize(0, 0);
+    if(!item->isLazy() || !item->widget || lazyReleaseTimeout < 0)
+        return;
+
+    item->extra->collapsedTime.start();
+    if(!releaseTimer || !releaseTimer->isActive())
+        releaseLazyPages();
+}
+
+// 销毁折叠或隐藏超时的延迟页面，并按最近的超时时间重新计时
+void AdvancedToolBoxPrivate::releaseLazyPages()
+{
+    if(lazyCount <= 0 || lazyReleaseTimeout < 0)
+        return;
+
+    qint64 next = -1;
     for(auto item : items)
     {
-        if(item->widget->isHidden())
+        if(!item->isLazy() || !item->widget || (item->isExpanded && !item->hidden))
             continue;
-        if(item->expanded())
-        {
-            min_size.rheight() += item->minSize.height();
-            min_size.rwidth() =  std::max(item->minSize.width(), min_size.width());
+        QElapsedTimer &collapsedTime = item->extra->collapsedTime;
+        if(!collapsedTime.isValid())
+            collapsedTime.start();
 
-            size.rheight() += item->sizeHint.height();
-            size.rwidth() =  std::max(item->sizeHint.width(), size.width());
-        }
+        qint64 remain = lazyReleaseTimeout - collapsedTime.elapsed();
+        if(remain > 0)
         {
-            QSize title = item->tabTitle->sizeHint();
-            min_size.rheight() += title.height();
-            size.rheight() += title.height();
+            next = next < 0 ? remain : qMin(next, remain);
+            continue;
         }
-        handle_h += handleWidth;
+
+        QWidget *widget = item->widget;
+        QObject::disconnect(widget, &QWidget::destroyed, this, &AdvancedToolBoxPrivate::widgetDestroyed);
+        widgetItems.remove(widget);
+        item->widget = nullptr;
+        // 保留最后一次的尺寸，重新创建前按照该尺寸布局
+        item->extra->estimate = item->sizeHint;
+        collapsedTime.invalidate();
+        widget->hide();
+        widget->deleteLater();
     }
-    min_size.rheight() += std::max(handle_h - handleWidth, 0);
-    size.rheight() += std::max(handle_h - handleWidth, 0);
-    if(minSizeHint != min_size || sizeHint != size)
+
+    if(next >= 0)
     {
-        minSizeHint = min_size;
-        sizeHint = size;
-        Q_Q(AdvancedToolBox);
-        q->updateGeometry();
+        if(!releaseTimer)
+        {
+            releaseTimer = new QTimer(this);
+            releaseTimer->setSingleShot(true);
+            connect(releaseTimer, &QTimer::timeout, this, &AdvancedToolBoxPrivate::releaseLazyPages);
+        }
+        releaseTimer->start(int(next));
     }
 }
 
+bool AdvancedToolBoxPrivate::eventFilter(QObject *watched, QEvent *event)
+{
+    if(watched == viewport && event->type() == QEvent::Resize)
+        updateVirtualPages();
+    else if(paintedTitles && event->type() == QEvent::Enter && !pressItem)
+        setHover(QPoint(-1, -1)); // 鼠标从标题进入页面
+    return QObject::eventFilter(watched, event);
+}
+
 ToolBoxSplitterHandle::ToolBoxSplitterHandle(AdvancedToolBox *parent)
     : QWidget(parent)
 {
@@ -1184,7 +4291,7 @@ void ToolBoxSplitterHandle::mouseMoveEvent(QMouseEvent *event)
     {
         QPoint pos = event->globalPos();
         AdvancedToolBox *box = static_cast<AdvancedToolBox *>(parentWidget());
-        box->d_ptr->moveHandle(_index, pos.y() - moveStart.y());
+        box->d_ptr->handleMoved(_index, pos.y() - moveStart.y());
     }
 }
 
@@ -1195,7 +4302,7 @@ void ToolBoxSplitterHandle::mousePressEvent(QMouseEvent *event)
         pressed = true;
         moveStart = event->globalPos();
         AdvancedToolBox *box = static_cast<AdvancedToolBox *>(parentWidget());
-        box->d_ptr->resetManualSize();
+        box->d_ptr->handlePressed(_index);
     }
 }
 
@@ -1205,7 +4312,7 @@ void ToolBoxSplitterHandle::mouseReleaseEvent(QMouseEvent *event)
     {
         pressed = false;
         AdvancedToolBox *box = static_cast<AdvancedToolBox *>(parentWidget());
-        box->d_ptr->resetManualSize();
+        box->d_ptr->handleReleased();
     }
 }
 
@@ -1216,7 +4323,7 @@ ToolBoxTitle::ToolBoxTitle(const QString &label, const QIcon &icon, AdvancedTool
 {
     setText(label);
     setIcon(icon);
-    setIconSize(QSize(16, 16));
+    setIconSize(titleIconSize);
     connect(this, &ToolBoxTitle::clicked, this, [this]()
             { emit titleClicked(tabIndex); });
     setContextMenuPolicy(Qt::CustomContextMenu);
@@ -1226,33 +4333,25 @@ ToolBoxTitle::ToolBoxTitle(const QString &label, const QIcon &icon, AdvancedTool
     setAttribute(Qt::WA_Hover);
 }
 
+// 高度使用AdvancedToolBox统一计算的结果，宽度只在文字变化后重新测量
 QSize ToolBoxTitle::sizeHint() const
 {
-    if(_sizeHint.isValid())
-        return _sizeHint;
+    AdvancedToolBox *box = static_cast<AdvancedToolBox *>(parentWidget());
+    const int height = box->d_ptr->titleHeight(!this->icon().isNull());
+    if(_sizeHint.isValid() && _sizeHintText == this->text())
+        return QSize(_sizeHint.width(), height);
 
     ensurePolished();
     QStyleOptionTab opt;
     opt.initFrom(this);
+    opt.text = this->text();
     if(this->expanded)
         opt.state |= QStyle::State_On;
-    if(this->underMouse())
-        opt.state |= QStyle::State_MouseOver;
 
-    QWidget *parent = parentWidget();
-    int w = style()->pixelMetric(QStyle::PM_TabBarTabHSpace, &opt, parent);
-    int h = style()->pixelMetric(QStyle::PM_TabBarTabVSpace, &opt, parent);
-
-    bool nullicon = this->icon().isNull();
-    QSize icon_size = nullicon ? QSize(0, 0) : this->iconSize();
-    w += icon_size.width();
-    w += nullicon ? 0 : 4;
-
-    const QFontMetrics fm = fontMetrics();
-    w += fm.size(0, this->text()).width();
-    h += qMax(fm.height(), icon_size.height());
-    _sizeHint = style()->sizeFromContents(QStyle::CT_TabBarTab, &opt, QSize(w, h), parent);
-    return _sizeHint;
+    QSize icon_size = this->icon().isNull() ? QSize(0, 0) : this->iconSize();
+    _sizeHint = toolBoxTitleSize(opt, icon_size, style(), parentWidget());
+    _sizeHintText = opt.text;
+    return QSize(_sizeHint.width(), height);
 }
 
 bool ToolBoxTitle::event(QEvent *e)
@@ -1325,52 +4424,18 @@ void ToolBoxTitle::initStyleOption(QStyleOptionToolBox *option) const
 
 void ToolBoxTitle::paintEvent(QPaintEvent *)
 {
-    QWidget *parent = parentWidget();
-
     QStyleOptionToolBox tabopt;
     initStyleOption(&tabopt);
 
     QPainter painter(this);
-    style()->drawControl(QStyle::CE_ToolBoxTabShape, &tabopt, &painter, parent);
-
-    int indent = static_cast<AdvancedToolBox *>(parentWidget())->textIndentation();
-    // draw branch
-    if(indent > 0)
-    {
-        QStyleOptionViewItem branchopt;
-        branchopt.rect = tabopt.rect;
-        branchopt.state = tabopt.state;
-        branchopt.state &= ~QStyle::State_MouseOver;
-        branchopt.state |= hoverBranch ? QStyle::State_MouseOver : QStyle::State_None;
-        branchopt.state |= QStyle::State_Children;
-        branchopt.rect.setRight(tabopt.rect.left() + indent);
-        style()->drawPrimitive(QStyle::PE_IndicatorBranch, &branchopt, &painter, parent);
-    }
-    tabopt.rect.setLeft(tabopt.rect.left() + indent);
-
-    // draw icon
-    bool null_icon = this->icon().isNull();
-    int icon_width = this->iconSize().width();
-    if(!null_icon)
-    {
-        QRect cr = style()->subElementRect(QStyle::SE_ToolBoxTabContents, &tabopt, parent);
-        cr.setWidth(icon_width + 2);
-        cr.moveLeft(cr.left() + 2);
-        QIcon::Mode mode = tabopt.state & QStyle::State_Enabled ? QIcon::Normal : QIcon::Disabled;
-        if(mode == QIcon::Normal && tabopt.state & QStyle::State_HasFocus)
-            mode = QIcon::Active;
-        QIcon::State state = tabopt.state & QStyle::State_Open ? QIcon::On : QIcon::Off;
-        this->icon().paint(&painter, cr, Qt::AlignCenter, mode, state);
-        tabopt.rect.adjust(icon_width + 4, 0, 0, 0);
-    }
-
-    // draw text
-    if(!tabopt.text.isEmpty())
-    {
-        tabopt.icon = QIcon();
-        // QStyleOptionToolBox固定左对齐。可以考虑使用 QStyleOptionTab 绘制文本，以支持样式对齐，不过默认是居中样式。
-        style()->drawControl(QStyle::CE_ToolBoxTabLabel, &tabopt, &painter, parent);
-    }
+    AdvancedToolBox *box = static_cast<AdvancedToolBox *>(parentWidget());
+    int indent = box->textIndentation();
+    AdvancedToolBoxPrivate *d = box->d_ptr.data();
+    TOOLBOX_STATS_ADD(d, titlePaintCount);
+    if(d->titleCacheEnable)
+        drawCachedToolBoxTitle(tabopt, hoverBranch, indent, iconSize(), d->titleStyleSerial, style(), &painter, box);
+    else
+        drawToolBoxTitle(tabopt, hoverBranch, indent, iconSize(), style(), &painter, box);
 }
 
 #include "advancedtoolbox.moc"
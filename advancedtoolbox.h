@@ -4,7 +4,12 @@
 #include <QFrame>
 #include <QWidget>
 #include <QIcon>
+#include <QModelIndex>
+#include <functional>
 
+class QAbstractItemModel;
+class QAction;
+class QScrollBar;
 class AdvancedToolBoxPrivate;
 class ToolBoxTitle;
 class ToolBoxSplitterHandle;
@@ -19,11 +24,40 @@ public:
     QSize sizeHint() const;
     QSize minimumSizeHint() const;
 
+    typedef std::function<QWidget *()> WidgetFactory;
+
     void addWidget(QWidget * widget, const QString & label, const QIcon & icon = QIcon());
+    // 延迟创建页面，页面第一次展开或可见时才调用factory创建widget，创建前使用estimatedSize布局
+    void addLazyWidget(const WidgetFactory & factory, const QString & label,
+                       const QSize & estimatedSize = QSize(), const QIcon & icon = QIcon());
+    // 延迟创建的页面折叠或隐藏超过msec后销毁widget，再次展开时重新创建，小于0则不销毁
+    void setLazyReleaseTimeout(int msec);
+
+    typedef std::function<QSize()> SizeProvider;
+    // 在线程池中计算页面的建议尺寸，provider中不能访问widget，只能根据数据计算（例如QTextLayout配合QImage测量文字）。
+    // 结果返回前使用原有尺寸，返回后代替widget的sizeHint，多个结果合并为一次布局；provider为空时取消
+    void setItemSizeProvider(int index, const SizeProvider & provider);
+
+    typedef std::function<QWidget *(const QModelIndex &)> PageFactory;
+    // 使用model中root下的行作为页面，DisplayRole为标题，DecorationRole为图标，SizeHintRole为widget创建前的预估尺寸，
+    // 页面widget在第一次展开或可见时由factory创建。设置后原有页面被移除，model模式下拖拽排序通过model的moveRows完成。
+    // model模式下页面与行一一对应：addWidget、addLazyWidget、takeIndex和populate不生效，restoreState返回false；
+    // 排序、过滤等layoutChanged只重新排列页面，保留已创建的widget和展开状态
+    void setModel(QAbstractItemModel * model, const PageFactory & factory, const QModelIndex & root = QModelIndex());
+    QAbstractItemModel * model() const;
+
     int indexOf(QWidget * widget);
+    // pos所在的页面（包括页面上方的handle、标题和内容区域），不在任何页面上时返回-1
+    int indexAt(const QPoint & pos) const;
+    // 移除页面并返回widget，延迟页面还未创建时先由factory创建。
+    // 只有index越界、model模式或factory返回空时才返回nullptr
     QWidget * takeIndex(int index);
     QWidget * widget(int index);
 
+    // 保存和恢复页面顺序、展开和隐藏状态以及页面高度，恢复时页面按照添加的顺序对应
+    QByteArray saveState() const;
+    bool restoreState(const QByteArray & state);
+
     void setItemExpand(int index, bool expand = true);
     void setItemVisible(int index, bool visible = true);
 
@@ -35,12 +69,142 @@ public:
     int textIndentation();
     void resetTextIndentation(int indent = -1);
 
+    // 拖动handle时调整页面的方式
+    enum ResizeMode
+    {
+        OpaqueResize,    // 每次鼠标移动都立即调整页面
+        PreviewResize,   // 拖动时只显示预览线，松开鼠标后调整
+        ThrottledResize  // 合并鼠标移动，最多每16ms调整一次
+    };
+    void setResizeMode(ResizeMode mode);
+    ResizeMode resizeMode() const;
+
     void setDragSortEnable(bool enable);
+
+    // 在标题右键菜单末尾添加应用自己的action，菜单显示前发送titleMenuAboutToShow
+    void addTitleMenuAction(QAction * action);
+    void removeTitleMenuAction(QAction * action);
     void setAnimationEnable(bool enable);
+    // 展开和折叠动画使用页面截图，动画过程中不再反复调整页面widget的尺寸
+    void setSnapshotAnimationEnable(bool enable);
+    // 标题和分割线由AdvancedToolBox直接绘制，不再为每个页面创建标题和handle子窗口
+    void setPaintedTitleEnable(bool enable);
+    // 标题绘制结果缓存到QPixmapCache中，悬停等状态变化时直接贴图
+    void setTitleCacheEnable(bool enable);
+
+    // 虚拟化模式，用于QScrollArea等场景，只有可见区域内的页面才创建容器
+    void setVirtualizationEnable(bool enable);
+
+    // 滚动模式：使用自带的垂直滚动条，只布局和显示可见区域内的页面，当前页面标题固定在顶部。
+    // 该模式下总是使用绘制标题和虚拟化，不需要再放入QScrollArea
+    void setScrollEnable(bool enable);
+    bool isScrollEnable() const;
+    QScrollBar *verticalScrollBar() const;
+    void scrollToIndex(int index);
+
+    // 延迟布局，页面修改后只标记，在下一次事件循环中合并执行一次布局
+    void setDeferredLayoutEnable(bool enable);
+    // 所有AdvancedToolBox共用相同的标题文字，同一个QIcon（相同cacheKey）的副本共用预渲染的pixmap，适合大量重复标题和图标的页面
+    void setSharedResourcesEnable(bool enable);
+
+    // 内存占用估计，子窗口按固定的大致开销计算，共用的文字和图标只计一次
+    struct MemoryReport
+    {
+        int pageCount = 0;
+        int widgetCount = 0;    // 为页面创建的标题、handle和容器
+        qint64 itemBytes = 0;   // 页面记录，包括延迟创建、model页面单独分配的部分
+        qint64 widgetBytes = 0;
+        qint64 textBytes = 0;
+        qint64 iconBytes = 0;
+        qint64 totalBytes() const { return itemBytes + widgetBytes + textBytes + iconBytes; }
+        qint64 bytesPerPage() const { return pageCount > 0 ? totalBytes() / pageCount : 0; }
+    };
+    MemoryReport memoryReport() const;
+
+    // 折叠或隐藏的页面真正隐藏widget并关闭刷新，页面可以在hideEvent/showEvent中暂停和恢复定时器等工作
+    void setSuspendCollapsedPages(bool enable);
+
+    // 批量修改页面，beginUpdate与endUpdate之间的布局操作延迟到最外层endUpdate时统一执行一次
+    void beginUpdate();
+    void endUpdate();
+
+    // 分批填充页面时generator每次提供的页面，widget为空时使用factory延迟创建
+    struct PopulatePage
+    {
+        QWidget * widget = nullptr;
+        QString label;
+        QIcon icon;
+        WidgetFactory factory;
+        QSize estimatedSize;
+    };
+    // 填充下一个页面，返回false表示没有更多页面
+    typedef std::function<bool(PopulatePage & page)> PageGenerator;
+    // 异步分批添加页面，每一批在frameBudget毫秒内尽量多地添加，批之间回到事件循环，每一批结束后布局一次。
+    // total为页面总数，仅用于populateProgress，未知时为-1。重复调用会先取消正在进行的填充
+    void populate(const PageGenerator & generator, int total = -1, int frameBudget = 8);
+    // 取消后已添加的页面保留，generator中尚未提供的页面由调用者处理
+    void cancelPopulate();
+    bool isPopulating() const;
+
+    class UpdateGuard
+    {
+    public:
+        explicit UpdateGuard(AdvancedToolBox * box) : box(box) { box->beginUpdate(); }
+        ~UpdateGuard() { box->endUpdate(); }
+    private:
+        Q_DISABLE_COPY(UpdateGuard)
+        AdvancedToolBox * box;
+    };
+
+    // 运行统计，用于分析卡顿来自AdvancedToolBox还是页面widget。
+    // setStatsEnable(true)后开始统计，定义ADVANCEDTOOLBOX_NO_STATS时统计代码不参与编译
+    struct Stats
+    {
+        quint64 layoutCount = 0;         // doLayout
+        qint64 layoutNsecs = 0;
+        quint64 geometryUpdateCount = 0; // updateGeometries
+        qint64 geometryUpdateNsecs = 0;
+        quint64 sizeHintCount = 0;       // resetSizeHint
+        qint64 sizeHintNsecs = 0;
+        quint64 itemSizeCount = 0;       // 计算页面尺寸
+        qint64 itemSizeNsecs = 0;
+        quint64 geometrySetCount = 0;    // 设置页面容器、标题和handle位置
+        quint64 animationFrameCount = 0;
+        quint64 titlePaintCount = 0;
+    };
+    void setStatsEnable(bool enable);
+    Stats stats() const;
+    void resetStats();
+
+    // 将space按sizes当前的比例分配到各项上（space为负时压缩），结果限制在[minimums, maximums]内，
+    // 尺寸为0的项在其余项全部达到限制后平均分配剩余空间。order为调用方提供的临时数组，长度不小于count。
+    // 返回因全部达到最大/最小值而未能分配的空间
+    static int distributeSpace(int * sizes, const int * minimums, const int * maximums,
+                               int count, int space, int * order);
+
+signals:
+    // restoreState改变的展开状态同样发送，在新的顺序布局完成之后
+    void itemExpanded(int index);
+    void itemCollapsed(int index);
+    // 页面内容因展开、折叠、显示或隐藏而变为可见或不可见
+    void pageShown(int index);
+    void pageHidden(int index);
+    void populateProgress(int count, int total);
+    void populateFinished(bool canceled);
+    // index为右键点击的页面，不在页面标题上时为-1
+    void titleMenuAboutToShow(int index);
+    // 统计数据变化后，在下一次事件循环中发送
+    void statsUpdated(const AdvancedToolBox::Stats & stats);
 
 protected:
     bool event(QEvent *e);
     void paintEvent(QPaintEvent *event);
+    void wheelEvent(QWheelEvent *event);
+    void mousePressEvent(QMouseEvent *event);
+    void mouseMoveEvent(QMouseEvent *event);
+    void mouseReleaseEvent(QMouseEvent *event);
+    void contextMenuEvent(QContextMenuEvent *event);
+    void leaveEvent(QEvent *event);
     void dragEnterEvent(QDragEnterEvent *event);
     void dragMoveEvent(QDragMoveEvent *event);
     void dropEvent(QDropEvent *event);
@@ -57,6 +221,9 @@ private:
     friend class ToolBoxSplitterHandle;
 };
 
+// 用于statsUpdated的排队连接和QVariant
+Q_DECLARE_METATYPE(AdvancedToolBox::Stats)
+
 class ToolBoxSplitterHandle : public QWidget
 {
 public:
@@ -0,0 +1,26 @@
+#-------------------------------------------------
+#
+# AdvancedToolBox 布局/交互性能测试，使用 offscreen 平台运行
+#
+#-------------------------------------------------
+
+QT       += core gui
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets concurrent
+
+TARGET = AdvancedToolBoxBenchmark
+TEMPLATE = app
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+INCLUDEPATH += ..
+
+SOURCES += \
+        main.cpp \
+    ../advancedtoolbox.cpp
+
+HEADERS += \
+    ../advancedtoolbox.h
@@ -0,0 +1,371 @@
+﻿#include "advancedtoolbox.h"
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QDropEvent>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFrame>
+#include <QMimeData>
+#include <QMouseEvent>
+#include <QTextStream>
+#include <QTimer>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <new>
+
+// 全局统计堆分配次数，用于衡量热路径上的内存分配
+static std::atomic<unsigned long long> allocCount(0);
+
+void *operator new(std::size_t size)
+{
+    allocCount.fetch_add(1, std::memory_order_relaxed);
+    if(size == 0)
+        size = 1;
+    if(void *p = std::malloc(size))
+        return p;
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    std::free(p);
+}
+
+struct Sample
+{
+    QVector<qint64> nsecs;
+    unsigned long long allocs = 0;
+};
+
+// 记录一次操作的耗时和分配次数
+class Probe
+{
+  public:
+    explicit Probe(Sample &s)
+        : sample(s)
+        , allocStart(allocCount.load())
+    {
+        timer.start();
+    }
+    ~Probe()
+    {
+        const qint64 ns = timer.nsecsElapsed();
+        sample.allocs += allocCount.load() - allocStart;
+        sample.nsecs.append(ns);
+    }
+
+  private:
+    Sample &sample;
+    unsigned long long allocStart;
+    QElapsedTimer timer;
+};
+
+static QWidget *createPage(int i)
+{
+    QFrame *frame = new QFrame();
+    if(i % 3 == 0)
+        frame->setMaximumHeight(300);
+    if(i % 5 == 0)
+        frame->setMinimumHeight(50);
+    return frame;
+}
+
+// shown为false时窗口不上屏：仍然可见并收到Resize事件，但没有expose，不产生绘制
+static AdvancedToolBox *createBox(int pages, bool animation, bool shown = true)
+{
+    AdvancedToolBox *box = new AdvancedToolBox();
+    box->setAnimationEnable(animation);
+    box->resize(400, 600);
+    if(!shown)
+        box->setAttribute(Qt::WA_DontShowOnScreen);
+    box->show();
+    for(int i = 0; i < pages; i++)
+        box->addWidget(createPage(i), QString("Page %1").arg(i));
+    box->resize(400, qMax(600, box->minimumSizeHint().height()));
+    QCoreApplication::processEvents();
+    return box;
+}
+
+static void waitFor(int ms)
+{
+    QEventLoop loop;
+    QTimer::singleShot(ms, &loop, SLOT(quit()));
+    loop.exec();
+}
+
+static void report(QTextStream &out, const QString &name, int pages, const Sample &s)
+{
+    if(s.nsecs.isEmpty())
+        return;
+    QVector<qint64> sorted = s.nsecs;
+    std::sort(sorted.begin(), sorted.end());
+    qint64 total = 0;
+    for(qint64 v : sorted)
+        total += v;
+    const int n = sorted.size();
+    const int p99 = qBound(0, int(std::ceil(n * 0.99)) - 1, n - 1);
+    out << QString("%1 %2 %3 %4 %5 %6")
+               .arg(name, -22)
+               .arg(pages, 6)
+               .arg(n, 6)
+               .arg(total / 1000.0 / n, 12, 'f', 2)
+               .arg(sorted.at(p99) / 1000.0, 12, 'f', 2)
+               .arg(double(s.allocs) / n, 10, 'f', 1)
+        << '\n';
+    out.flush();
+}
+
+static void benchAddWidget(QTextStream &out, int pages)
+{
+    Sample s;
+    s.nsecs.reserve(pages);
+    AdvancedToolBox *box = new AdvancedToolBox();
+    box->setAnimationEnable(false);
+    box->resize(400, 600);
+    box->show();
+    for(int i = 0; i < pages; i++)
+    {
+        QWidget *page = createPage(i);
+        const QString label = QString("Page %1").arg(i);
+        Probe p(s);
+        box->addWidget(page, label);
+    }
+    report(out, "addWidget", pages, s);
+    delete box;
+}
+
+// 在beginUpdate/endUpdate中批量添加，整体只计一次
+static void benchAddWidgetBatch(QTextStream &out, int pages)
+{
+    Sample s;
+    AdvancedToolBox *box = new AdvancedToolBox();
+    box->setAnimationEnable(false);
+    box->resize(400, 600);
+    box->show();
+    QList<QWidget *> list;
+    for(int i = 0; i < pages; i++)
+        list.append(createPage(i));
+    {
+        Probe p(s);
+        AdvancedToolBox::UpdateGuard guard(box);
+        for(int i = 0; i < pages; i++)
+            box->addWidget(list.at(i), QString("Page %1").arg(i));
+    }
+    report(out, "addWidget(batch)", pages, s);
+    delete box;
+}
+
+// 分批填充，记录每一批（含批末布局）的耗时，即填充期间事件循环最长被阻塞的时间
+static void benchPopulate(QTextStream &out, int pages)
+{
+    Sample s;
+    AdvancedToolBox *box = new AdvancedToolBox();
+    box->setAnimationEnable(false);
+    box->resize(400, 600);
+    box->show();
+    int next = 0;
+    bool chunkStart = true;
+    QElapsedTimer chunk;
+    QEventLoop loop;
+    QObject::connect(box, &AdvancedToolBox::populateProgress, [&]() {
+        s.nsecs.append(chunk.nsecsElapsed());
+        chunkStart = true;
+    });
+    QObject::connect(box, &AdvancedToolBox::populateFinished, &loop, &QEventLoop::quit);
+    box->populate([&](AdvancedToolBox::PopulatePage &page) -> bool {
+        if(chunkStart)
+        {
+            chunk.start();
+            chunkStart = false;
+        }
+        if(next >= pages)
+            return false;
+        page.widget = createPage(next);
+        page.label = QString("Page %1").arg(next);
+        next++;
+        return true;
+    }, pages);
+    loop.exec();
+    report(out, "populate(chunk)", pages, s);
+    delete box;
+}
+
+// 不上屏的窗口不产生绘制，分配次数只反映布局本身，预热后应为0
+static unsigned long long benchResize(QTextStream &out, int pages, int iterations, bool shown = true)
+{
+    AdvancedToolBox *box = createBox(pages, false, shown);
+    const int h = box->height();
+    box->resize(440, h + 200);
+    box->resize(400, h);
+    Sample s;
+    s.nsecs.reserve(iterations);
+    for(int i = 0; i < iterations; i++)
+    {
+        Probe p(s);
+        box->resize(400 + (i % 2) * 40, h + (i % 2) * 200);
+    }
+    report(out, shown ? "doLayout(resize)" : "doLayout(hidden)", pages, s);
+    delete box;
+    return s.allocs;
+}
+
+static void benchExpand(QTextStream &out, int pages, int iterations, bool animation)
+{
+    AdvancedToolBox *box = createBox(pages, animation);
+    Sample s;
+    s.nsecs.reserve(iterations);
+    for(int i = 0; i < iterations; i++)
+    {
+        const int index = (i / 2 * 7) % pages;
+        {
+            Probe p(s);
+            box->setItemExpand(index, i % 2 != 0);
+        }
+        if(animation)
+            waitFor(130);
+    }
+    report(out, animation ? "setItemExpand(anim)" : "setItemExpand", pages, s);
+    delete box;
+}
+
+static unsigned long long benchMoveHandle(QTextStream &out, int pages, int iterations, bool shown = true)
+{
+    AdvancedToolBox *box = createBox(pages, false, shown);
+    QList<ToolBoxSplitterHandle *> handles;
+    for(ToolBoxSplitterHandle *handle : box->findChildren<ToolBoxSplitterHandle *>())
+    {
+        if(handle->isVisibleTo(box))
+            handles.append(handle);
+    }
+    if(handles.isEmpty())
+    {
+        delete box;
+        return 0;
+    }
+
+    ToolBoxSplitterHandle *handle = handles.at(handles.count() / 2);
+    const QPoint local = handle->rect().center();
+    const QPoint global = handle->mapToGlobal(local);
+    QMouseEvent press(QEvent::MouseButtonPress, local, global, Qt::LeftButton, Qt::LeftButton, Qt::NoModifier);
+    QCoreApplication::sendEvent(handle, &press);
+
+    // 来回拖动，覆盖放大和缩小两个方向；先完整拖动一个来回预热，之后才计数
+    auto moveTo = [&](int i) {
+        const int dy = (i % 40 < 20 ? i % 20 : 20 - i % 20) * 6 - 60;
+        QPoint pos = local + QPoint(0, dy);
+        QMouseEvent move(QEvent::MouseMove, pos, handle->mapToGlobal(pos), Qt::NoButton, Qt::LeftButton, Qt::NoModifier);
+        QCoreApplication::sendEvent(handle, &move);
+    };
+    for(int i = 0; i < 40; i++)
+        moveTo(i);
+
+    Sample s;
+    s.nsecs.reserve(iterations);
+    for(int i = 0; i < iterations; i++)
+    {
+        Probe p(s);
+        moveTo(i);
+    }
+
+    QMouseEvent release(QEvent::MouseButtonRelease, local, global, Qt::LeftButton, Qt::NoButton, Qt::NoModifier);
+    QCoreApplication::sendEvent(handle, &release);
+    report(out, shown ? "moveHandle" : "moveHandle(hidden)", pages, s);
+    delete box;
+    return s.allocs;
+}
+
+static void benchDrop(QTextStream &out, int pages, int iterations)
+{
+    AdvancedToolBox *box = createBox(pages, false);
+    Sample s;
+    s.nsecs.reserve(iterations);
+    for(int i = 0; i < iterations; i++)
+    {
+        QMimeData data;
+        data.setData("advanced-toolbox-drag-index", QByteArray::number((i * 31) % pages));
+        const QPoint pos(box->width() / 2, (i * 7919) % qMax(1, box->height()));
+        QDropEvent drop(pos, Qt::MoveAction, &data, Qt::LeftButton, Qt::NoModifier);
+        Probe p(s);
+        QCoreApplication::sendEvent(box, &drop);
+    }
+    report(out, "dropEvent", pages, s);
+    delete box;
+}
+
+int main(int argc, char *argv[])
+{
+    if(qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM"))
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+
+    QApplication app(argc, argv);
+    QCommandLineParser parser;
+    parser.setApplicationDescription("AdvancedToolBox layout benchmark");
+    parser.addHelpOption();
+    QCommandLineOption sizesOption("sizes", "Comma separated page counts.", "list", "10,100,1000,5000");
+    QCommandLineOption iterOption("iterations", "Iterations for repeated cases.", "count", "200");
+    QCommandLineOption checkOption("check-allocs", "Exit with failure if a (hidden) layout case allocates after warm-up.");
+    parser.addOption(sizesOption);
+    parser.addOption(iterOption);
+    parser.addOption(checkOption);
+    parser.process(app);
+
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+    const auto skipEmpty = Qt::SkipEmptyParts;
+#else
+    const auto skipEmpty = QString::SkipEmptyParts;
+#endif
+    QList<int> sizes;
+    for(const QString &v : parser.value(sizesOption).split(',', skipEmpty))
+    {
+        bool ok = false;
+        int n = v.trimmed().toInt(&ok);
+        if(ok && n > 0)
+            sizes.append(n);
+    }
+    const int iterations = qMax(1, parser.value(iterOption).toInt());
+
+    QTextStream out(stdout);
+    out << QString("%1 %2 %3 %4 %5 %6")
+               .arg("case", -22)
+               .arg("pages", 6)
+               .arg("iters", 6)
+               .arg("mean(us)", 12)
+               .arg("p99(us)", 12)
+               .arg("allocs/op", 10)
+        << '\n';
+
+    unsigned long long hiddenAllocs = 0;
+    for(int pages : sizes)
+    {
+        benchAddWidget(out, pages);
+        benchAddWidgetBatch(out, pages);
+        benchPopulate(out, pages);
+        benchResize(out, pages, iterations);
+        hiddenAllocs += benchResize(out, pages, iterations, false);
+        benchExpand(out, pages, iterations, false);
+        benchExpand(out, pages, qMin(iterations, 20), true);
+        benchMoveHandle(out, pages, iterations);
+        hiddenAllocs += benchMoveHandle(out, pages, iterations, false);
+        benchDrop(out, pages, iterations);
+    }
+
+    if(parser.isSet(checkOption) && hiddenAllocs > 0)
+    {
+        out << QString("FAIL: (hidden) cases allocated %1 times after warm-up").arg(hiddenAllocs) << '\n';
+        return 1;
+    }
+    return 0;
+}
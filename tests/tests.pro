@@ -0,0 +1,26 @@
+#-------------------------------------------------
+#
+# AdvancedToolBox 单元测试
+#
+#-------------------------------------------------
+
+QT       += core gui testlib
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets concurrent
+
+TARGET = AdvancedToolBoxTests
+TEMPLATE = app
+
+CONFIG += c++11 console testcase
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+INCLUDEPATH += ..
+
+SOURCES += \
+        tst_distributespace.cpp \
+    ../advancedtoolbox.cpp
+
+HEADERS += \
+    ../advancedtoolbox.h
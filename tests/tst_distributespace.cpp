@@ -0,0 +1,111 @@
+﻿#include "advancedtoolbox.h"
+
+#include <QtTest>
+
+class TestDistributeSpace : public QObject
+{
+    Q_OBJECT
+
+  private:
+    // 调用distributeSpace并检查结果都在限制内、分配总和加上剩余等于space
+    static int distribute(QVector<int> &sizes, const QVector<int> &minimums, const QVector<int> &maximums, int space)
+    {
+        const QVector<int> before = sizes;
+        QVector<int> order(sizes.count());
+        const int remain = AdvancedToolBox::distributeSpace(sizes.data(), minimums.constData(), maximums.constData(),
+                                                            sizes.count(), space, order.data());
+        qint64 given = 0;
+        for(int i = 0; i < sizes.count(); i++)
+        {
+            given += sizes.at(i) - before.at(i);
+            if(sizes.at(i) < minimums.at(i) || sizes.at(i) > maximums.at(i))
+                qWarning("page %d out of range: %d not in [%d, %d]", i, sizes.at(i), minimums.at(i), maximums.at(i));
+        }
+        if(given + remain != space)
+            qWarning("given %lld + remain %d != space %d", given, remain, space);
+        return remain;
+    }
+
+  private slots:
+    void clamping()
+    {
+        QVector<int> sizes{100, 100, 100};
+        QCOMPARE(distribute(sizes, {0, 0, 0}, {120, 1000, 1000}, 90), 0);
+        QCOMPARE(sizes, (QVector<int>{120, 135, 135}));
+
+        sizes = {100, 100, 100};
+        QCOMPARE(distribute(sizes, {90, 0, 0}, {1000, 1000, 1000}, -60), 0);
+        QCOMPARE(sizes, (QVector<int>{90, 75, 75}));
+    }
+
+    void exactSum()
+    {
+        QVector<int> sizes{1, 1, 1};
+        QCOMPARE(distribute(sizes, {0, 0, 0}, {1000, 1000, 1000}, 100), 0);
+        QCOMPARE(sizes.at(0) + sizes.at(1) + sizes.at(2), 103);
+
+        sizes = {10, 20, 30};
+        QCOMPARE(distribute(sizes, {0, 0, 0}, {1000, 1000, 1000}, -7), 0);
+        QCOMPARE(sizes.at(0) + sizes.at(1) + sizes.at(2), 53);
+    }
+
+    void allZero()
+    {
+        QVector<int> sizes{0, 0, 0, 0};
+        QCOMPARE(distribute(sizes, {0, 0, 0, 0}, {1000, 1000, 1000, 1000}, 10), 0);
+        for(int size : sizes)
+            QVERIFY(size == 2 || size == 3);
+    }
+
+    // 尺寸大于0的项全部达到最大值后，剩余空间分给尺寸为0的项
+    void zeroWeightRemainder()
+    {
+        QVector<int> sizes{211, 0};
+        QCOMPARE(distribute(sizes, {0, 0}, {240, 184}, 504), 504 - 29 - 184);
+        QCOMPARE(sizes, (QVector<int>{240, 184}));
+
+        sizes = {50, 0, 0};
+        QCOMPARE(distribute(sizes, {0, 0, 0}, {60, 1000, 1000}, 30), 0);
+        QCOMPARE(sizes, (QVector<int>{60, 10, 10}));
+    }
+
+    // 随机数据：结果在限制内，总和准确，只有全部达到限制时才有剩余
+    void randomized()
+    {
+        quint32 seed = 1;
+        auto next = [&seed](int bound) -> int {
+            seed = seed * 1103515245u + 12345u;
+            return int((seed >> 8) % quint32(bound));
+        };
+        for(int round = 0; round < 20000; round++)
+        {
+            const int count = 1 + next(8);
+            QVector<int> sizes(count), minimums(count), maximums(count);
+            for(int i = 0; i < count; i++)
+            {
+                minimums[i] = next(3) ? 0 : next(100);
+                maximums[i] = minimums.at(i) + next(300);
+                sizes[i] = next(3) ? minimums.at(i) + next(maximums.at(i) - minimums.at(i) + 1) : minimums.at(i);
+            }
+            const int space = next(1200) - 600;
+            QVector<int> result = sizes;
+            QVector<int> order(count);
+            const int remain = AdvancedToolBox::distributeSpace(result.data(), minimums.constData(), maximums.constData(),
+                                                                count, space, order.data());
+            int given = 0;
+            bool limited = true;
+            for(int i = 0; i < count; i++)
+            {
+                QVERIFY(result.at(i) >= minimums.at(i) && result.at(i) <= maximums.at(i));
+                given += result.at(i) - sizes.at(i);
+                limited = limited && result.at(i) == (space > 0 ? maximums.at(i) : minimums.at(i));
+            }
+            QCOMPARE(given + remain, space);
+            QVERIFY(remain == 0 || limited);
+        }
+    }
+};
+
+QTEST_APPLESS_MAIN(TestDistributeSpace)
+
+#include "tst_distributespace.moc"